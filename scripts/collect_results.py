@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+
+# Merges the per-test benchmarking results files written by a ctest run (see RESULTS_DIR in
+# CMakeLists.txt) into one report, with wall and CPU time per test.
+
+import argparse
+import glob
+import json
+import os
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+
+    run_info = data.get('run_info', {})
+    test = {
+        'results_file': os.path.abspath(path),
+        'wall_time': data.get('end_time', 0) - data.get('init_time', 0),
+        'user_time': run_info.get('user_time'),
+        'system_time': run_info.get('system_time'),
+        'iterations': sum(s.get('iterations', 0) for s in run_info.get('latency', [])),
+        'latency': run_info.get('latency', []),
+    }
+    if test['user_time'] is not None and test['system_time'] is not None:
+        test['cpu_time'] = test['user_time'] + test['system_time']
+    return test
+
+
+def main():
+
+    arg_parser = argparse.ArgumentParser(description='Merge tracetooltests benchmarking results files into one report.')
+    arg_parser.add_argument('paths', nargs='*', default=['results'], help='results files, or directories of them (default: results)')
+    arg_parser.add_argument('-o', '--output', default='merged_results.json', help='merged report file (default: merged_results.json)')
+    args = arg_parser.parse_args()
+
+    files = []
+    for path in args.paths:
+        if os.path.isdir(path):
+            files += sorted(glob.glob(os.path.join(path, '*.json')))
+        else:
+            files.append(path)
+    if not files:
+        print('No results files found', file=sys.stderr)
+        return 1
+
+    tests = {}
+    for path in files:
+        name = os.path.splitext(os.path.basename(path))[0]
+        try:
+            tests[name] = load(path)
+        except (OSError, ValueError) as e:
+            print(f'Skipping {path}: {e}', file=sys.stderr)
+
+    total = {
+        'tests': len(tests),
+        'wall_time': sum(t['wall_time'] for t in tests.values()),
+        'cpu_time': sum(t.get('cpu_time', 0) for t in tests.values()),
+    }
+    with open(args.output, 'w') as f:
+        json.dump({'total': total, 'tests': tests}, f, indent=4)
+
+    print(f'{"test":<50} {"wall (s)":>10} {"cpu (s)":>10} {"iterations":>10}')
+    for name, t in sorted(tests.items(), key=lambda item: item[1]['wall_time'], reverse=True):
+        cpu = f'{t["cpu_time"] / 1e9:10.3f}' if 'cpu_time' in t else f'{"-":>10}'
+        print(f'{name:<50} {t["wall_time"] / 1e9:10.3f} {cpu} {t["iterations"]:>10}')
+    print(f'{len(tests)} tests, {total["wall_time"] / 1e9:.3f}s wall and {total["cpu_time"] / 1e9:.3f}s CPU in total, written to {args.output}')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,143 @@
+// Validates the optimized Adler-32 implementations and the chunked checksum service against the scalar
+// reference, then measures their throughput across a range of buffer sizes.
+
+#include "util.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+static size_t max_size = 64 * 1024 * 1024;
+static size_t bytes_per_size = 256 * 1024 * 1024;
+static bool skip_benchmark = false;
+
+static void show_usage()
+{
+	printf("Usage: adler32_bench [options]\n");
+	printf("-h/--help              This help\n");
+	printf("-m/--max-size N        Largest buffer size to benchmark in kilobytes (default %d)\n", (int)(max_size / 1024));
+	printf("-b/--bytes N           Megabytes to checksum for each buffer size (default %d)\n", (int)(bytes_per_size / 1024 / 1024));
+	printf("-v/--validate-only     Only validate implementations, do not benchmark them\n");
+	exit(-1);
+}
+
+static bool validate(adler32_impl impl, const unsigned char* data, size_t size)
+{
+	const uint32_t expected = adler32_reference(data, size);
+	const uint32_t result = adler32_with(impl, data, size);
+	if (result != expected)
+	{
+		ELOG("%s: size %lu gave %08x, expected %08x", adler32_name(impl), (unsigned long)size, (unsigned)result, (unsigned)expected);
+		return false;
+	}
+	// continuing a checksum in uneven pieces must give the same result
+	const size_t split = size / 3 + 1;
+	uint32_t adler = adler32_with(impl, data, std::min(split, size));
+	if (split < size) adler = adler32_with(impl, data + split, size - split, adler);
+	if (adler != expected)
+	{
+		ELOG("%s: size %lu split at %lu gave %08x, expected %08x", adler32_name(impl), (unsigned long)size, (unsigned long)split, (unsigned)adler, (unsigned)expected);
+		return false;
+	}
+	return true;
+}
+
+// Negative impl selects the reference implementation
+static inline uint32_t checksum(int impl, const unsigned char* data, size_t size, uint32_t adler)
+{
+	if (impl < 0) return adler32_reference(data, size) ^ adler;
+	return adler32_with((adler32_impl)impl, data, size, adler);
+}
+
+static double measure(int impl, const unsigned char* data, size_t size)
+{
+	const size_t loops = std::max<size_t>(1, bytes_per_size / size);
+	uint32_t adler = 1;
+	const uint64_t start = gettime();
+	for (size_t i = 0; i < loops; i++)
+	{
+		adler = checksum(impl, data, size, adler);
+		asm volatile("" ::: "memory"); // do not let the compiler merge calls on the same data
+	}
+	const uint64_t time = std::max<uint64_t>(1, gettime() - start);
+	if (adler == 0) printf("\n"); // make sure the result is used
+	return (double)loops * size / time; // bytes per nanosecond equals GB/s
+}
+
+int main(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (match(argv[i], "-h", "--help")) show_usage();
+		else if (match(argv[i], "-m", "--max-size")) max_size = (size_t)get_arg(argv, ++i, argc) * 1024;
+		else if (match(argv[i], "-b", "--bytes")) bytes_per_size = (size_t)get_arg(argv, ++i, argc) * 1024 * 1024;
+		else if (match(argv[i], "-v", "--validate-only")) skip_benchmark = true;
+		else
+		{
+			ELOG("Unrecognized cmd line parameter: %s", argv[i]);
+			show_usage();
+		}
+	}
+
+	// Random data, plus a buffer of all 0xff which is the worst case for overflowing the deferred modulo
+	const size_t validate_size = 3 * 5552 * 32 + 77;
+	std::vector<unsigned char> data(std::max(max_size, validate_size));
+	srandom(1234);
+	for (unsigned char& c : data) c = random() & 0xff;
+	std::vector<unsigned char> ones(validate_size, 0xff);
+
+	bool ok = true;
+	for (int impl = 0; impl < ADLER32_IMPL_COUNT; impl++)
+	{
+		if (!adler32_supported((adler32_impl)impl)) { printf("%-8s not supported\n", adler32_name((adler32_impl)impl)); continue; }
+		for (size_t size = 0; size < 300; size++) ok &= validate((adler32_impl)impl, data.data() + (size & 7), size);
+		for (size_t size : { (size_t)5551, (size_t)5552, (size_t)5553, validate_size - 1, validate_size })
+		{
+			ok &= validate((adler32_impl)impl, data.data() + 1, size);
+			ok &= validate((adler32_impl)impl, ones.data(), size);
+		}
+		printf("%-8s validated\n", adler32_name((adler32_impl)impl));
+	}
+	// combining chunk checksums, with a chunk size that is not a multiple of the SIMD block size
+	chunked_checksum chunked(1000, 4);
+	const uint32_t expected = adler32_reference(data.data(), validate_size);
+	if (chunked.checksum(data.data(), validate_size) != expected) { ELOG("Chunked checksum failed"); ok = false; }
+	data[12345] ^= 0x5a;
+	data[validate_size - 1] ^= 0x5a;
+	chunked.mark_dirty(12345, 1);
+	chunked.mark_dirty(validate_size - 1, 1);
+	if (chunked.update() != adler32_reference(data.data(), validate_size)) { ELOG("Chunked checksum update failed"); ok = false; }
+	data[12345] ^= 0x5a;
+	data[validate_size - 1] ^= 0x5a;
+	chunked.mark_dirty(0, validate_size);
+	if (chunked.update() != expected) { ELOG("Chunked checksum full update failed"); ok = false; }
+	printf("%-8s validated\n", "chunked");
+
+	if (!ok) return 1;
+	if (skip_benchmark) return 0;
+
+	printf("\n%10s %10s", "size", "reference");
+	for (int impl = 0; impl < ADLER32_IMPL_COUNT; impl++) if (adler32_supported((adler32_impl)impl)) printf(" %10s", adler32_name((adler32_impl)impl));
+	printf("     (GB/s)\n");
+	for (size_t size = 64; size <= max_size; size *= 4)
+	{
+		printf("%10lu %10.2f", (unsigned long)size, measure(-1, data.data(), size));
+		for (int impl = 0; impl < ADLER32_IMPL_COUNT; impl++)
+		{
+			if (!adler32_supported((adler32_impl)impl)) continue;
+			printf(" %10.2f", measure(impl, data.data(), size));
+		}
+		printf("\n");
+	}
+
+	chunked_checksum service;
+	const uint64_t start = gettime();
+	const uint32_t adler = service.checksum(data.data(), max_size);
+	const uint64_t full = gettime() - start;
+	service.mark_dirty(max_size / 2, 1);
+	const uint64_t start_update = gettime();
+	service.update();
+	const uint64_t update = gettime() - start_update;
+	printf("\nchunked: %lu bytes in %lu chunks, checksum %08x at %.2f GB/s, rehash of one dirty chunk took %lu ns\n", (unsigned long)max_size,
+	       (unsigned long)service.digests().size(), (unsigned)adler, (double)max_size / std::max<uint64_t>(1, full), (unsigned long)update);
+	return 0;
+}
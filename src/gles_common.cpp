@@ -24,6 +24,8 @@ static bool inject_asserts = false;
 static PFNGLINSERTEVENTMARKEREXTPROC my_glInsertEventMarkerEXT = nullptr;
 static bool step_mode = false;
 
+static void readback_flush();
+
 static void dummy_glAssertBuffer_ARM(GLenum target, GLsizei offset, GLsizei size, const char *md5)
 {
 	(void)target;
@@ -60,7 +62,7 @@ static bool check_bench(TOOLSTEST& b, const TOOLSTEST_INIT& reqs)
 	if (enable_path)
 	{
 		printf("Reading benchmarking enable file: %s\n", enable_path);
-		uint32_t size = 0;
+		size_t size = 0;
 		content = load_blob(enable_path, &size);
 	}
 	else if (enable_json)
@@ -120,7 +122,7 @@ void annotate(const char *annotation)
 	if (my_glInsertEventMarkerEXT) my_glInsertEventMarkerEXT(0, annotation);
 }
 
-static bool has_extension(const char* name)
+bool has_extension(const char* name)
 {
 	GLint max = 0;
 	glGetIntegerv(GL_NUM_EXTENSIONS, &max);
@@ -201,7 +203,7 @@ int init(int argc, char** argv, const TOOLSTEST_INIT& init)
 		}
 	}
 
-	check_bench(handle, init);
+	if (check_bench(handle, init)) bench_reserve(handle.bench, handle.times);
 
 #ifdef SDL
 	SDL_SetMainReady();
@@ -456,6 +458,7 @@ int init(int argc, char** argv, const TOOLSTEST_INIT& init)
 #endif
 		}
 	}
+	readback_flush();
 	bench_done(handle.bench);
 	init.done(&handle);
 
@@ -498,12 +501,55 @@ int init(int argc, char** argv, const char *name, TOOLSTEST_CALLBACK_SWAP swap,
 	return init(argc, argv, initparam);
 }
 
+// Ring of persistent pixel pack buffers for assert_fb(), so that the readback of frame N is verified
+// during frame N + 2 instead of stalling the pipeline on every frame.
+struct readback
+{
+	GLuint pbo = 0;
+	GLsync sync = 0;
+	GLsizei size = 0;
+};
+static const int readback_depth = 3;
+static readback readback_ring[readback_depth];
+static int readback_next = 0;
+
+static void readback_verify(readback& r)
+{
+	if (!r.sync) return;
+	GLenum e = glClientWaitSync(r.sync, GL_SYNC_FLUSH_COMMANDS_BIT, 100 * 1000 * 1000);
+	if (e == GL_TIMEOUT_EXPIRED) // we get this on Note3, not sure why
+	{
+		DLOG("Wait for sync object timed out");
+	}
+	else if (e != GL_CONDITION_SATISFIED && e != GL_ALREADY_SIGNALED)
+	{
+		ELOG("Wait for sync object failed, got %x as response", e);
+	}
+	glDeleteSync(r.sync);
+	r.sync = 0;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+	glAssertBuffer_ARM(GL_PIXEL_PACK_BUFFER, 0, r.size, "0123456789abcdef");
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+/// Verify the readbacks still in flight, oldest first, and release the ring
+static void readback_flush()
+{
+	for (int i = 0; i < readback_depth; i++)
+	{
+		readback& r = readback_ring[(readback_next + i) % readback_depth];
+		readback_verify(r);
+		if (r.pbo) glDeleteBuffers(1, &r.pbo);
+		r = readback();
+	}
+	readback_next = 0;
+}
+
 // before calling this, add appropriate memory barriers
 void assert_fb(TOOLSTEST* handle)
 {
 	if (!inject_asserts) return;
 
-	GLuint pbo;
 	GLenum internalformat = fb_internalformat();
 	int mult;
 	GLenum format;
@@ -516,24 +562,25 @@ void assert_fb(TOOLSTEST* handle)
 	case GL_RGBA8: mult = 4; format = GL_RGBA; type = GL_UNSIGNED_BYTE; break;
 	default: ELOG("Bad internal format"); abort(); break;
 	}
-	glGenBuffers(1, &pbo);
-	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
-	glBufferData(GL_PIXEL_PACK_BUFFER, handle->width * handle->height * mult, NULL, GL_DYNAMIC_READ);
-	glReadPixels(0, 0, handle->width, handle->height, format, type, 0);
-	GLsync s = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-	GLenum e = glClientWaitSync(s, GL_SYNC_FLUSH_COMMANDS_BIT, 100 * 1000 * 1000);
-	if (e == GL_TIMEOUT_EXPIRED) // we get this on Note3, not sure why
-	{
-		DLOG("Wait for sync object timed out");
-	}
-	else if (e != GL_CONDITION_SATISFIED && e != GL_ALREADY_SIGNALED)
+
+	// this slot was verified two frames ago, so it is free to reuse
+	readback& r = readback_ring[readback_next];
+	assert(r.sync == 0);
+	const GLsizei size = handle->width * handle->height * mult;
+	if (!r.pbo) glGenBuffers(1, &r.pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+	if (r.size != size)
 	{
-		ELOG("Wait for sync object failed, got %x as response", e);
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_DYNAMIC_READ);
+		r.size = size;
 	}
-	glDeleteSync(s);
-	glAssertBuffer_ARM(GL_PIXEL_PACK_BUFFER, 0, handle->width * handle->height * mult, "0123456789abcdef");
+	glReadPixels(0, 0, handle->width, handle->height, format, type, 0);
 	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-	glDeleteBuffers(1, &pbo);
+	r.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback_next = (readback_next + 1) % readback_depth;
+
+	// verify the readback from two frames ago, which is the oldest one still in flight
+	readback_verify(readback_ring[readback_next]);
 }
 
 void compile(const char *name, GLint shader)
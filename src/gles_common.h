@@ -98,6 +98,8 @@ void compile(const char *name, GLint shader);
 void link_shader(const char *name, GLint program);
 GLenum fb_internalformat();
 bool is_null_run();
+/// Whether the current context supports the given GL extension
+bool has_extension(const char* name);
 void annotate(const char *annotation);
 
 void test_swap(TOOLSTEST* handle, int i = 0);
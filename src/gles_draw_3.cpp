@@ -0,0 +1,214 @@
+// Draw call throughput benchmark. Issues a large number of small draws per frame with a configurable mix of
+// program switches, vertex array switches, uniform updates and texture binds in between, and reports the
+// number of draws per second and the CPU time per frame spent issuing them.
+
+#include "gles_common.h"
+
+static int draws = 10000;
+static int program_every = 100;
+static int vao_every = 10;
+static int uniform_every = 1;
+static int texture_every = 10;
+static int instances = 0;
+
+static const int pool_size = 4; // number of programs, vertex arrays and textures to switch between
+
+static const char *vertex_shader_source[] = GLSL_VS(
+	in vec4 a_v4Position;
+	uniform vec4 u_v4Offset;
+	out vec2 v_v2TexCoord;
+	void main()
+	{
+		v_v2TexCoord = a_v4Position.xy;
+		gl_Position = a_v4Position * vec4(0.01, 0.01, 1.0, 1.0) + u_v4Offset + vec4(float(gl_InstanceID) * 0.001, 0.0, 0.0, 0.0);
+	}
+);
+
+static const char *fragment_shader_source[] = GLSL_FS(
+	precision mediump float;
+	in vec2 v_v2TexCoord;
+	uniform sampler2D s_texture;
+	out vec4 fragColor;
+	void main()
+	{
+		fragColor = texture(s_texture, v_v2TexCoord);
+	}
+);
+
+static const float triangleVertices[] =
+{
+	0.0f,  0.5f, 0.0f,
+	-0.5f, -0.5f, 0.0f,
+	0.5f, -0.5f, 0.0f,
+};
+
+static const GLushort indices[] =
+{
+	0, 1, 2
+};
+
+static GLuint vs, fs, vpos_obj, index_obj;
+static GLuint programs[pool_size];
+static GLint offset_locations[pool_size];
+static GLuint vaos[pool_size];
+static GLuint textures[pool_size];
+static uint64_t draw_time = 0;
+static int frames = 0;
+
+static void our_usage()
+{
+	printf("-D/--draws N           Number of draws per frame (default %d)\n", draws);
+	printf("-p/--program-every N   Switch program every N draws, zero for never (default %d)\n", program_every);
+	printf("-a/--vao-every N       Switch vertex array every N draws, zero for never (default %d)\n", vao_every);
+	printf("-u/--uniform-every N   Update a uniform every N draws, zero for never (default %d)\n", uniform_every);
+	printf("-x/--texture-every N   Bind another texture every N draws, zero for never (default %d)\n", texture_every);
+	printf("-I/--instanced N       Use glDrawElementsInstanced with N instances per draw (default %d, not instanced)\n", instances);
+}
+
+static bool test_cmdopt(int& i, int argc, char** argv)
+{
+	if (match(argv[i], "-D", "--draws"))
+	{
+		draws = get_arg(argv, ++i, argc);
+		return draws > 0;
+	}
+	else if (match(argv[i], "-p", "--program-every"))
+	{
+		program_every = get_arg(argv, ++i, argc);
+		return program_every >= 0;
+	}
+	else if (match(argv[i], "-a", "--vao-every"))
+	{
+		vao_every = get_arg(argv, ++i, argc);
+		return vao_every >= 0;
+	}
+	else if (match(argv[i], "-u", "--uniform-every"))
+	{
+		uniform_every = get_arg(argv, ++i, argc);
+		return uniform_every >= 0;
+	}
+	else if (match(argv[i], "-x", "--texture-every"))
+	{
+		texture_every = get_arg(argv, ++i, argc);
+		return texture_every >= 0;
+	}
+	else if (match(argv[i], "-I", "--instanced"))
+	{
+		instances = get_arg(argv, ++i, argc);
+		return instances >= 0;
+	}
+	return false;
+}
+
+static int setupGraphics(TOOLSTEST *handle)
+{
+	glViewport(0, 0, handle->width, handle->height);
+	glClearColor(0.0f, 0.0f, 0.5f, 1.0f);
+
+	vs = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vs, 1, vertex_shader_source, NULL);
+	compile("vertex_shader_source", vs);
+	fs = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fs, 1, fragment_shader_source, NULL);
+	compile("fragment_shader_source", fs);
+	for (int i = 0; i < pool_size; i++)
+	{
+		programs[i] = glCreateProgram();
+		glAttachShader(programs[i], vs);
+		glAttachShader(programs[i], fs);
+		glBindAttribLocation(programs[i], 0, "a_v4Position");
+		link_shader("draw_program", programs[i]);
+		glUseProgram(programs[i]);
+		glUniform1i(glGetUniformLocation(programs[i], "s_texture"), 0);
+		offset_locations[i] = glGetUniformLocation(programs[i], "u_v4Offset");
+	}
+
+	glGenBuffers(1, &vpos_obj);
+	glBindBuffer(GL_ARRAY_BUFFER, vpos_obj);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(triangleVertices), triangleVertices, GL_STATIC_DRAW);
+	glGenBuffers(1, &index_obj);
+	glGenVertexArrays(pool_size, vaos);
+	for (int i = 0; i < pool_size; i++)
+	{
+		glBindVertexArray(vaos[i]);
+		glBindBuffer(GL_ARRAY_BUFFER, vpos_obj);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_obj);
+		if (i == 0) glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	}
+	glBindVertexArray(0);
+
+	glGenTextures(pool_size, textures);
+	for (int i = 0; i < pool_size; i++)
+	{
+		const GLubyte pixel[4] = { (GLubyte)(64 * i), 255, 0, 255 };
+		glBindTexture(GL_TEXTURE_2D, textures[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+	return 0;
+}
+
+static void callback_draw(TOOLSTEST *handle)
+{
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	const uint64_t start = gettime();
+	int program = 0;
+	glUseProgram(programs[program]);
+	glBindVertexArray(vaos[0]);
+	glBindTexture(GL_TEXTURE_2D, textures[0]);
+	glUniform4f(offset_locations[program], 0.0f, 0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < draws; i++)
+	{
+		if (program_every && i % program_every == 0)
+		{
+			program = (i / program_every) % pool_size;
+			glUseProgram(programs[program]);
+		}
+		if (vao_every && i % vao_every == 0) glBindVertexArray(vaos[(i / vao_every) % pool_size]);
+		if (texture_every && i % texture_every == 0) glBindTexture(GL_TEXTURE_2D, textures[(i / texture_every) % pool_size]);
+		if (uniform_every && i % uniform_every == 0)
+		{
+			const float x = (float)(i % 199) / 100.0f - 0.99f;
+			const float y = (float)((i / 199) % 199) / 100.0f - 0.99f;
+			glUniform4f(offset_locations[program], x, y, 0.0f, 0.0f);
+		}
+		if (instances) glDrawElementsInstanced(GL_TRIANGLES, 3, GL_UNSIGNED_SHORT, NULL, instances);
+		else glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_SHORT, NULL);
+	}
+	draw_time += gettime() - start;
+	frames++;
+	glBindVertexArray(0);
+}
+
+static void test_cleanup(TOOLSTEST *handle)
+{
+	if (draw_time > 0)
+	{
+		printf("%d draws per frame: %.0f draws/sec, %.3f ms CPU time per frame\n", draws, (double)draws * frames * 1000000000.0 / draw_time,
+		       (double)draw_time / frames / 1000000.0);
+	}
+	glDeleteVertexArrays(pool_size, vaos);
+	glDeleteTextures(pool_size, textures);
+	for (int i = 0; i < pool_size; i++) glDeleteProgram(programs[i]);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+	glDeleteBuffers(1, &vpos_obj);
+	glDeleteBuffers(1, &index_obj);
+}
+
+int main(int argc, char** argv)
+{
+	TOOLSTEST_INIT initparam;
+	initparam.name = "gles_draw_3";
+	initparam.swap = callback_draw;
+	initparam.init = setupGraphics;
+	initparam.done = test_cleanup;
+	initparam.usage = our_usage;
+	initparam.cmdopt = test_cmdopt;
+	return init(argc, argv, initparam);
+}
@@ -0,0 +1,282 @@
+// Multi-context scaling test. Runs N worker threads, each with its own context sharing objects with the
+// main context. Every frame the main thread updates a shared input texture and fences it, then each worker
+// waits on that fence, renders into its own framebuffer object sampling the input, and fences its result,
+// which the main thread waits on before compositing all results onto the screen. Reports the aggregate
+// number of worker frames per second.
+
+#include "gles_common.h"
+
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+static int num_threads = 2;
+static int draws = 100;
+
+static const GLsizei input_size = 64;
+static const GLsizei target_size = 256;
+
+struct worker
+{
+	std::thread thread;
+	GLuint color = 0; // shared texture that the worker renders into
+	GLsync fence = 0; // signalled when the worker is done rendering into color
+	int frames = 0;
+};
+
+static std::deque<worker> workers;
+static std::mutex mutex;
+static std::condition_variable start_cond;
+static std::condition_variable done_cond;
+static int generation = 0;
+static int finished = 0;
+static bool done = false;
+static GLsync input_fence = 0;
+static GLuint input_tex, vs, fs, draw_program, vpos_obj, vao;
+static GLint loc_transform;
+static uint64_t start_time = 0;
+static std::vector<GLubyte> pixels(input_size * input_size * 4);
+static TOOLSTEST_INIT initparam;
+
+static const char *vertex_shader_source[] = GLSL_VS(
+	uniform vec4 u_v4Transform;
+	in vec4 a_v4Position;
+	out vec2 v_v2TexCoord;
+	void main()
+	{
+		v_v2TexCoord = a_v4Position.xy * 0.5 + 0.5;
+		gl_Position = vec4(a_v4Position.xy * u_v4Transform.xy + u_v4Transform.zw, 0.0, 1.0);
+	}
+);
+
+static const char *fragment_shader_source[] = GLSL_FS(
+	precision mediump float;
+	in vec2 v_v2TexCoord;
+	uniform sampler2D s_texture;
+	out vec4 fragColor;
+	void main()
+	{
+		fragColor = texture(s_texture, v_v2TexCoord);
+	}
+);
+
+// one triangle covering the whole viewport
+static const float triangleVertices[] =
+{
+	-1.0f, -1.0f, 0.0f,
+	3.0f, -1.0f, 0.0f,
+	-1.0f, 3.0f, 0.0f,
+};
+
+static void our_usage()
+{
+	printf("-T/--threads N         Number of worker threads, each with its own context (default %d)\n", num_threads);
+	printf("-D/--draws N           Number of draws per worker frame (default %d)\n", draws);
+}
+
+static bool test_cmdopt(int& i, int argc, char** argv)
+{
+	if (match(argv[i], "-T", "--threads"))
+	{
+		num_threads = get_arg(argv, ++i, argc);
+		initparam.surfaces = num_threads + 1; // read by init() after parsing the command line
+		return num_threads > 0;
+	}
+	else if (match(argv[i], "-D", "--draws"))
+	{
+		draws = get_arg(argv, ++i, argc);
+		return draws > 0;
+	}
+	return false;
+}
+
+/// Create a program using the shared shader objects, and a vertex array using the shared vertex buffer,
+/// in the current context. Programs are per thread since uniform values are shared with the program.
+static GLuint create_program(GLuint* vertex_array, GLint* transform)
+{
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	glBindAttribLocation(program, 0, "a_v4Position");
+	link_shader("draw_program", program);
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "s_texture"), 0);
+	*transform = glGetUniformLocation(program, "u_v4Transform");
+
+	glGenVertexArrays(1, vertex_array);
+	glBindVertexArray(*vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, vpos_obj);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	return program;
+}
+
+static void thread_runner(TOOLSTEST *handle, int me)
+{
+	worker& w = workers.at(me);
+	test_makecurrent(handle, me + 1);
+
+	// framebuffer and vertex array objects are not shared between contexts
+	GLuint fbo, worker_vao;
+	GLint transform;
+	const GLuint program = create_program(&worker_vao, &transform);
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, w.color, 0);
+	assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+	glViewport(0, 0, target_size, target_size);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, input_tex);
+
+	int seen = 0;
+	std::unique_lock<std::mutex> lk(mutex);
+	while (true)
+	{
+		start_cond.wait(lk, [&]{ return generation != seen || done; });
+		if (done) break;
+		seen = generation;
+		const GLsync wait_fence = input_fence;
+		lk.unlock();
+
+		glWaitSync(wait_fence, 0, GL_TIMEOUT_IGNORED);
+		glClear(GL_COLOR_BUFFER_BIT);
+		for (int i = 0; i < draws; i++)
+		{
+			const float x = (float)((i + me * 7) % 10) / 5.0f - 0.9f;
+			const float y = (float)((i / 10) % 10) / 5.0f - 0.9f;
+			glUniform4f(transform, 0.05f, 0.05f, x, y);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+		}
+		const GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush(); // make the fence visible to the main context
+
+		lk.lock();
+		w.fence = fence;
+		w.frames++;
+		finished++;
+		done_cond.notify_one();
+	}
+	lk.unlock();
+
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteVertexArrays(1, &worker_vao);
+	glDeleteProgram(program);
+	eglMakeCurrent(handle->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglReleaseThread();
+}
+
+static int setupGraphics(TOOLSTEST *handle)
+{
+	glViewport(0, 0, handle->width, handle->height);
+	glClearColor(0.0f, 0.0f, 0.5f, 1.0f);
+
+	vs = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vs, 1, vertex_shader_source, NULL);
+	compile("vertex_shader_source", vs);
+	fs = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fs, 1, fragment_shader_source, NULL);
+	compile("fragment_shader_source", fs);
+	glGenBuffers(1, &vpos_obj);
+	glBindBuffer(GL_ARRAY_BUFFER, vpos_obj);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(triangleVertices), triangleVertices, GL_STATIC_DRAW);
+	draw_program = create_program(&vao, &loc_transform);
+
+	glGenTextures(1, &input_tex);
+	glBindTexture(GL_TEXTURE_2D, input_tex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, input_size, input_size);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	for (int i = 0; i < num_threads; i++)
+	{
+		workers.emplace_back();
+		glGenTextures(1, &workers.back().color);
+		glBindTexture(GL_TEXTURE_2D, workers.back().color);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, target_size, target_size);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+	glFinish(); // shared objects must be complete before the other contexts use them
+
+	for (int i = 0; i < num_threads; i++) workers[i].thread = std::thread(thread_runner, handle, i);
+	start_time = gettime();
+	return 0;
+}
+
+static void callback_draw(TOOLSTEST *handle)
+{
+	// update the shared input and hand it off to all workers
+	for (unsigned i = 0; i < pixels.size(); i++) pixels[i] = (GLubyte)(i + handle->current_frame * 16);
+	glBindTexture(GL_TEXTURE_2D, input_tex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, input_size, input_size, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	input_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush(); // make the fence visible to the worker contexts
+
+	std::unique_lock<std::mutex> lk(mutex);
+	finished = 0;
+	generation++;
+	start_cond.notify_all();
+	done_cond.wait(lk, [&]{ return finished == num_threads; });
+	lk.unlock();
+	glDeleteSync(input_fence);
+	input_fence = 0;
+
+	// composite the worker results into a grid of tiles
+	glClear(GL_COLOR_BUFFER_BIT);
+	glUseProgram(draw_program);
+	glBindVertexArray(vao);
+	int columns = 1;
+	while (columns * columns < num_threads) columns++;
+	const float scale = 1.0f / columns;
+	for (int i = 0; i < num_threads; i++)
+	{
+		glWaitSync(workers[i].fence, 0, GL_TIMEOUT_IGNORED);
+		glDeleteSync(workers[i].fence);
+		workers[i].fence = 0;
+		glBindTexture(GL_TEXTURE_2D, workers[i].color);
+		glUniform4f(loc_transform, scale, scale, -1.0f + scale * (2 * (i % columns) + 1), -1.0f + scale * (2 * (i / columns) + 1));
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	// verify in retracer
+	assert_fb(handle);
+}
+
+static void test_cleanup(TOOLSTEST *handle)
+{
+	const uint64_t elapsed = gettime() - start_time;
+	{
+		std::lock_guard<std::mutex> lk(mutex);
+		done = true;
+	}
+	start_cond.notify_all();
+	int frames = 0;
+	for (worker& w : workers)
+	{
+		w.thread.join();
+		frames += w.frames;
+		glDeleteTextures(1, &w.color);
+	}
+	printf("%d threads, %d draws per worker frame: %d worker frames, %.1f frames/sec aggregate\n", num_threads, draws, frames,
+	       (double)frames * 1000000000.0 / elapsed);
+	glDeleteTextures(1, &input_tex);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteBuffers(1, &vpos_obj);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+	glDeleteProgram(draw_program);
+}
+
+int main(int argc, char** argv)
+{
+	initparam.name = "gles_multithread_4";
+	initparam.swap = callback_draw;
+	initparam.init = setupGraphics;
+	initparam.done = test_cleanup;
+	initparam.usage = our_usage;
+	initparam.cmdopt = test_cmdopt;
+	initparam.surfaces = num_threads + 1;
+	return init(argc, argv, initparam);
+}
@@ -0,0 +1,277 @@
+// Streaming upload benchmark. Each frame uploads the same amount of data with each of several strategies,
+// drawing from every chunk right after it is written, and reports the upload rate of each strategy.
+
+#include "gles_common.h"
+
+enum strategy
+{
+	STRATEGY_SUBDATA, // glBufferSubData into one buffer
+	STRATEGY_ORPHAN, // glBufferData with NULL to orphan, then map
+	STRATEGY_UNSYNCHRONIZED, // unsynchronized map of a fenced ring buffer
+	STRATEGY_PERSISTENT, // persistent coherent map of a fenced ring buffer from GL_EXT_buffer_storage
+	STRATEGY_COUNT
+};
+
+static const char* strategy_names[STRATEGY_COUNT] = { "glBufferSubData", "orphaning", "unsynchronized ring", "persistent map" };
+
+static int megabytes = 4;
+static bool uniform = false;
+static int only_strategy = -1;
+
+static const GLsizeiptr chunk = 16 * 1024; // within the minimum GL_MAX_UNIFORM_BLOCK_SIZE
+static const int ring_regions = 3; // frames that the ring buffers can be ahead of the GPU
+
+static const char *vertex_shader_source[] = GLSL_VS(
+	in vec4 a_v4Position;
+	void main()
+	{
+		gl_Position = a_v4Position * 0.0;
+		gl_PointSize = 1.0;
+	}
+);
+
+static const char *uniform_vertex_shader_source[] = GLSL_VS(
+	layout(std140) uniform block
+	{
+		vec4 data[1024];
+	};
+	void main()
+	{
+		gl_Position = data[0] * 0.0;
+		gl_PointSize = 1.0;
+	}
+);
+
+static const char *fragment_shader_source[] = GLSL_FS(
+	out vec4 fragColor;
+	void main()
+	{
+		fragColor = vec4(1.0, 1.0, 1.0, 1.0);
+	}
+);
+
+static GLuint draw_program, vs, fs, vao;
+static GLuint buffers[STRATEGY_COUNT] = {};
+static GLsync fences[STRATEGY_COUNT][ring_regions] = {};
+static char* persistent_ptr = nullptr;
+static std::vector<char> source;
+static uint64_t upload_time[STRATEGY_COUNT] = {};
+static uint64_t upload_bytes[STRATEGY_COUNT] = {};
+static bool supported[STRATEGY_COUNT] = { true, true, true, false };
+static PFNGLBUFFERSTORAGEEXTPROC my_glBufferStorageEXT = nullptr;
+
+static void our_usage()
+{
+	printf("-m/--megabytes N       Megabytes uploaded per frame with each strategy (default %d)\n", megabytes);
+	printf("-u/--uniform           Stream through uniform buffers instead of vertex buffers\n");
+	printf("-S/--strategy N        Only test the given strategy (default all)\n");
+	for (int i = 0; i < STRATEGY_COUNT; i++) printf("\t%d - %s\n", i, strategy_names[i]);
+}
+
+static bool test_cmdopt(int& i, int argc, char** argv)
+{
+	if (match(argv[i], "-m", "--megabytes"))
+	{
+		megabytes = get_arg(argv, ++i, argc);
+		return megabytes > 0;
+	}
+	else if (match(argv[i], "-u", "--uniform"))
+	{
+		uniform = true;
+		return true;
+	}
+	else if (match(argv[i], "-S", "--strategy"))
+	{
+		only_strategy = get_arg(argv, ++i, argc);
+		return only_strategy >= 0 && only_strategy < STRATEGY_COUNT;
+	}
+	return false;
+}
+
+static GLenum target()
+{
+	return uniform ? GL_UNIFORM_BUFFER : GL_ARRAY_BUFFER;
+}
+
+/// Draw using the chunk at the given offset of the currently bound buffer
+static void draw_chunk(GLuint buffer, GLintptr offset)
+{
+	if (uniform)
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, 0, buffer, offset, chunk);
+	}
+	else
+	{
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (const void*)offset);
+	}
+	glDrawArrays(GL_POINTS, 0, 1);
+}
+
+/// Wait until the GPU is done with the given ring region, so that it can be written again
+static void wait_region(GLsync& sync)
+{
+	if (!sync) return;
+	GLenum e;
+	do
+	{
+		e = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 100 * 1000 * 1000);
+	} while (e == GL_TIMEOUT_EXPIRED);
+	if (e == GL_WAIT_FAILED) ELOG("Wait for sync object failed");
+	glDeleteSync(sync);
+	sync = 0;
+}
+
+static int setupGraphics(TOOLSTEST *handle)
+{
+	glViewport(0, 0, handle->width, handle->height);
+	glClearColor(0.0f, 0.0f, 0.5f, 1.0f);
+
+	draw_program = glCreateProgram();
+	vs = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vs, 1, uniform ? uniform_vertex_shader_source : vertex_shader_source, NULL);
+	compile("vertex_shader_source", vs);
+	fs = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fs, 1, fragment_shader_source, NULL);
+	compile("fragment_shader_source", fs);
+	glAttachShader(draw_program, vs);
+	glAttachShader(draw_program, fs);
+	glBindAttribLocation(draw_program, 0, "a_v4Position");
+	link_shader("draw_program", draw_program);
+	glUseProgram(draw_program);
+	if (uniform) glUniformBlockBinding(draw_program, glGetUniformBlockIndex(draw_program, "block"), 0);
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	if (!uniform) glEnableVertexAttribArray(0);
+
+	const GLsizeiptr size = (GLsizeiptr)megabytes * 1024 * 1024;
+	source.resize(size);
+	for (GLsizeiptr i = 0; i < size / (GLsizeiptr)sizeof(float); i++) ((float*)source.data())[i] = (float)(i % 1024) / 1024.0f;
+
+	my_glBufferStorageEXT = (PFNGLBUFFERSTORAGEEXTPROC)eglGetProcAddress("glBufferStorageEXT");
+	supported[STRATEGY_PERSISTENT] = has_extension("GL_EXT_buffer_storage") && my_glBufferStorageEXT;
+	if (!supported[STRATEGY_PERSISTENT]) printf("GL_EXT_buffer_storage not supported, skipping the persistent map strategy\n");
+
+	glGenBuffers(STRATEGY_COUNT, buffers);
+	glBindBuffer(target(), buffers[STRATEGY_SUBDATA]);
+	glBufferData(target(), size, NULL, GL_STREAM_DRAW);
+	glBindBuffer(target(), buffers[STRATEGY_ORPHAN]);
+	glBufferData(target(), chunk, NULL, GL_STREAM_DRAW);
+	glBindBuffer(target(), buffers[STRATEGY_UNSYNCHRONIZED]);
+	glBufferData(target(), size * ring_regions, NULL, GL_STREAM_DRAW);
+	if (supported[STRATEGY_PERSISTENT])
+	{
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT_EXT | GL_MAP_COHERENT_BIT_EXT;
+		glBindBuffer(target(), buffers[STRATEGY_PERSISTENT]);
+		my_glBufferStorageEXT(target(), size * ring_regions, NULL, flags);
+		persistent_ptr = (char*)glMapBufferRange(target(), 0, size * ring_regions, flags);
+		assert(persistent_ptr);
+	}
+	glBindBuffer(target(), 0);
+	return 0;
+}
+
+static void stream(int s, int frame)
+{
+	const GLsizeiptr size = (GLsizeiptr)source.size();
+	const int region = frame % ring_regions;
+	const GLuint buffer = buffers[s];
+	glBindBuffer(target(), buffer);
+
+	const uint64_t start = gettime();
+	switch (s)
+	{
+	case STRATEGY_SUBDATA:
+		for (GLsizeiptr offset = 0; offset < size; offset += chunk)
+		{
+			glBufferSubData(target(), offset, chunk, source.data() + offset);
+			draw_chunk(buffer, offset);
+		}
+		break;
+	case STRATEGY_ORPHAN:
+		for (GLsizeiptr offset = 0; offset < size; offset += chunk)
+		{
+			glBufferData(target(), chunk, NULL, GL_STREAM_DRAW);
+			void* ptr = glMapBufferRange(target(), 0, chunk, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			assert(ptr);
+			memcpy(ptr, source.data() + offset, chunk);
+			glUnmapBuffer(target());
+			draw_chunk(buffer, 0);
+		}
+		break;
+	case STRATEGY_UNSYNCHRONIZED:
+		wait_region(fences[s][region]);
+		for (GLsizeiptr offset = 0; offset < size; offset += chunk)
+		{
+			const GLintptr ring_offset = region * size + offset;
+			void* ptr = glMapBufferRange(target(), ring_offset, chunk, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			assert(ptr);
+			memcpy(ptr, source.data() + offset, chunk);
+			glUnmapBuffer(target());
+			draw_chunk(buffer, ring_offset);
+		}
+		fences[s][region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		break;
+	case STRATEGY_PERSISTENT:
+		wait_region(fences[s][region]);
+		for (GLsizeiptr offset = 0; offset < size; offset += chunk)
+		{
+			const GLintptr ring_offset = region * size + offset;
+			memcpy(persistent_ptr + ring_offset, source.data() + offset, chunk);
+			draw_chunk(buffer, ring_offset);
+		}
+		fences[s][region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+	upload_time[s] += gettime() - start;
+	upload_bytes[s] += size;
+}
+
+static void callback_draw(TOOLSTEST *handle)
+{
+	glClear(GL_COLOR_BUFFER_BIT);
+	for (int s = 0; s < STRATEGY_COUNT; s++)
+	{
+		if (!supported[s] || (only_strategy >= 0 && s != only_strategy)) continue;
+		stream(s, handle->current_frame);
+	}
+	glBindBuffer(target(), 0);
+}
+
+static void test_cleanup(TOOLSTEST *handle)
+{
+	glFinish();
+	printf("%s streaming, %d MB per frame in %d KB chunks:\n", uniform ? "Uniform buffer" : "Vertex buffer", megabytes, (int)(chunk / 1024));
+	for (int s = 0; s < STRATEGY_COUNT; s++)
+	{
+		for (int r = 0; r < ring_regions; r++) if (fences[s][r]) glDeleteSync(fences[s][r]);
+		if (upload_time[s] == 0) continue;
+		printf("\t%s: %.1f MB/s\n", strategy_names[s], upload_bytes[s] / 1024.0 / 1024.0 * 1000000000.0 / upload_time[s]);
+	}
+	if (persistent_ptr)
+	{
+		glBindBuffer(target(), buffers[STRATEGY_PERSISTENT]);
+		glUnmapBuffer(target());
+		glBindBuffer(target(), 0);
+	}
+	glDeleteBuffers(STRATEGY_COUNT, buffers);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteProgram(draw_program);
+}
+
+int main(int argc, char** argv)
+{
+	TOOLSTEST_INIT initparam;
+	initparam.name = "gles_streaming_1";
+	initparam.swap = callback_draw;
+	initparam.init = setupGraphics;
+	initparam.done = test_cleanup;
+	initparam.usage = our_usage;
+	initparam.cmdopt = test_cmdopt;
+	return init(argc, argv, initparam);
+}
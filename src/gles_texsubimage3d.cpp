@@ -1,5 +1,6 @@
 #include "gles_common.h"
 #include <vector>
+#include <algorithm>
 
 static GLuint maintex = 0;
 static GLenum internalformat = GL_RGB8;
@@ -9,6 +10,28 @@ static GLuint bytesperpixel = 3;
 static GLsizei dim = 512;
 static std::vector<char> buffer[2];
 static int upload_variant = 0;
+static bool benchmark = false;
+static int repeats = 5;
+static int max_count = 16;
+
+struct bench_format
+{
+	const char* name;
+	GLenum internalformat;
+	GLenum format; // zero for compressed formats
+	GLenum type;
+	GLsizei block; // block dimension in pixels
+	GLsizei block_bytes;
+};
+
+static const bench_format bench_formats[] =
+{
+	{ "RGBA8", GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 1, 4 },
+	{ "RGB8", GL_RGB8, GL_RGB, GL_UNSIGNED_BYTE, 1, 3 },
+	{ "R8", GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1, 1 },
+	{ "ETC2_RGB8", GL_COMPRESSED_RGB8_ETC2, 0, 0, 4, 8 },
+	{ "ASTC_4x4", GL_COMPRESSED_RGBA_ASTC_4x4, 0, 0, 4, 16 },
+};
 
 static void our_usage()
 {
@@ -20,10 +43,103 @@ static void our_usage()
 	printf("-u/--upload-variant N  Upload variant (default %d)\n", upload_variant);
 	printf("\t0 - glTexStorage3D\n");
 	printf("\t1 - glTexImage3D\n");
+	printf("-b/--benchmark         Sweep 2D texture uploads over texture count, size, format and upload source instead\n");
+	printf("                       Sizes go from 64 up to the texture size; each combination is its own benchmarking scene\n");
+	printf("-r/--repeats N         Timed upload batches per combination in benchmark mode (default %d)\n", repeats);
+	printf("-c/--count N           Maximum number of textures per batch in benchmark mode (default %d)\n", max_count);
+}
+
+/// Upload every texture once per batch, either from client memory or through a pixel unpack buffer, and
+/// time each batch including the time until the driver is done with it.
+static void upload_sweep(TOOLSTEST *handle)
+{
+	std::vector<char> source(dim * dim * 4);
+	for (unsigned i = 0; i < source.size(); i++) source[i] = (char)(i * 7);
+	GLuint pbo = 0;
+	glGenBuffers(1, &pbo);
+	// compressed formats are only listed if the context can actually create textures with them
+	GLint num_compressed = 0;
+	glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &num_compressed);
+	std::vector<GLint> compressed(num_compressed);
+	if (num_compressed > 0) glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, compressed.data());
+	std::vector<const bench_format*> formats;
+	for (const bench_format& f : bench_formats)
+	{
+		if (f.format == 0 && std::find(compressed.begin(), compressed.end(), (GLint)f.internalformat) == compressed.end())
+		{
+			printf("%s is not supported, skipping it\n", f.name);
+			continue;
+		}
+		formats.push_back(&f);
+	}
+
+	int combinations = 0;
+	for (GLsizei size = 64; size <= dim; size *= 2) for (int count = 1; count <= max_count; count *= 4) combinations += 2 * (int)formats.size();
+	bench_reserve(handle->bench, handle->times + combinations * repeats);
+
+	for (const bench_format* fp : formats)
+	{
+		const bench_format& f = *fp;
+		for (GLsizei size = 64; size <= dim; size *= 2)
+		{
+			const GLsizei bytes = (size / f.block) * (size / f.block) * f.block_bytes;
+			for (int count = 1; count <= max_count; count *= 4)
+			{
+				std::vector<GLuint> textures(count);
+				glGenTextures(count, textures.data());
+				for (GLuint t : textures)
+				{
+					glBindTexture(GL_TEXTURE_2D, t);
+					glTexStorage2D(GL_TEXTURE_2D, 1, f.internalformat, size, size);
+				}
+				for (int use_pbo = 0; use_pbo < 2; use_pbo++)
+				{
+					const std::string scene = std::string(f.name) + " " + _to_string(size) + "x" + _to_string(size) + " x" + _to_string(count) + (use_pbo ? " pbo" : " client");
+					bench_start_scene(handle->bench, scene);
+					uint64_t upload_time = 0;
+					for (int r = 0; r < repeats; r++)
+					{
+						bench_start_iteration(handle->bench);
+						const uint64_t start = gettime();
+						if (use_pbo)
+						{
+							glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+							glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)bytes * count, nullptr, GL_STREAM_DRAW);
+							for (int i = 0; i < count; i++) glBufferSubData(GL_PIXEL_UNPACK_BUFFER, (GLintptr)bytes * i, bytes, source.data());
+						}
+						for (int i = 0; i < count; i++)
+						{
+							const void* data = use_pbo ? (const void*)((uintptr_t)bytes * i) : (const void*)source.data();
+							glBindTexture(GL_TEXTURE_2D, textures[i]);
+							if (f.format) glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, f.format, f.type, data);
+							else glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, f.internalformat, bytes, data);
+						}
+						if (use_pbo) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+						glFinish();
+						upload_time += gettime() - start;
+						bench_stop_iteration(handle->bench);
+					}
+					bench_stop_scene(handle->bench);
+					printf("\t%s: %.1f MB/s\n", scene.c_str(), (double)bytes * count * repeats / 1024.0 / 1024.0 * 1000000000.0 / upload_time);
+				}
+				glBindTexture(GL_TEXTURE_2D, 0);
+				glDeleteTextures(count, textures.data());
+			}
+		}
+	}
+	glDeleteBuffers(1, &pbo);
+	// the regular frame loop only clears in benchmark mode, keep its timings apart from the sweep
+	bench_start_scene(handle->bench, "frames");
 }
 
 static int setupGraphics(TOOLSTEST *handle)
 {
+	if (benchmark)
+	{
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		upload_sweep(handle);
+		return 0;
+	}
 	buffer[0].resize(dim * dim * dim * bytesperpixel);
 	buffer[1].resize(dim * dim * dim * bytesperpixel);
 	memset(buffer[0].data(), 0xbe, buffer[0].size());
@@ -50,6 +166,7 @@ static void callback_draw(TOOLSTEST *handle)
 	int i = 0;
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
+	if (benchmark) return;
 
 	GLuint curr = dim;
 	for (; curr >= 16; curr /= 2)
@@ -61,7 +178,7 @@ static void callback_draw(TOOLSTEST *handle)
 
 static void test_cleanup(TOOLSTEST *handle)
 {
-	glDeleteTextures(1, &maintex);
+	if (maintex) glDeleteTextures(1, &maintex);
 }
 
 static bool test_cmdopt(int& i, int argc, char** argv)
@@ -76,6 +193,21 @@ static bool test_cmdopt(int& i, int argc, char** argv)
 		upload_variant = get_arg(argv, ++i, argc);
 		return true;
 	}
+	else if (match(argv[i], "-b", "--benchmark"))
+	{
+		benchmark = true;
+		return true;
+	}
+	else if (match(argv[i], "-r", "--repeats"))
+	{
+		repeats = get_arg(argv, ++i, argc);
+		return repeats > 0;
+	}
+	else if (match(argv[i], "-c", "--count"))
+	{
+		max_count = get_arg(argv, ++i, argc);
+		return max_count > 0;
+	}
 	else if (match(argv[i], "-f", "--format-variant"))
 	{
 		unsigned format_variant = get_arg(argv, ++i, argc);
@@ -24,7 +24,7 @@ static bool check_bench(opencl_setup_t& cl, opencl_req_t& reqs, const char* test
 	if (enable_path)
 	{
 		printf("Reading benchmarking enable file: %s\n", enable_path);
-		uint32_t size = 0;
+		size_t size = 0;
 		content = load_blob(enable_path, &size);
 	}
 	else if (enable_json)
@@ -5,6 +5,11 @@
 #include <termios.h>
 #include <unistd.h>
 #include <string.h>
+#include <math.h>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 #if defined(_GNU_SOURCE) || defined(__BIONIC__)
 #include <pthread.h>
@@ -12,6 +17,14 @@
 #include <sys/prctl.h>
 #endif
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define HAVE_ADLER32_AVX2 1 // built with a target attribute, only used if the CPU supports it
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #ifdef SDL
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
@@ -28,14 +41,131 @@ int get_env_int(const char* name, int fallback)
 	return v;
 }
 
+long get_rss()
+{
+	long pages = 0;
+	long resident = 0;
+	FILE* fp = fopen("/proc/self/statm", "r");
+	if (!fp) return 0;
+	if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = 0;
+	fclose(fp);
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
 uint_fast8_t p__loops = get_env_int("TOOLSTEST_TIMES", 10);
 uint_fast8_t p__sanity = get_env_int("TOOLSTEST_SANITY", 0);
 uint_fast8_t p__debug_level = get_env_int("TOOLSTEST_DEBUG", 0);
 uint_fast8_t p__validation = get_env_int("TOOLSTEST_VALIDATION", 0);
 
+void latency_histogram::merge(const latency_histogram& other)
+{
+	for (int i = 0; i < bucket_count; i++) counts[i] += other.counts[i];
+	total += other.total;
+	sum += other.sum;
+	min = std::min(min, other.min);
+	max = std::max(max, other.max);
+}
+
+uint64_t latency_histogram::percentile(double p) const
+{
+	if (total == 0) return 0;
+	const uint64_t target = std::max<uint64_t>(1, (uint64_t)ceil(p / 100.0 * total));
+	uint64_t seen = 0;
+	for (int i = 0; i < bucket_count; i++)
+	{
+		seen += counts[i];
+		if (seen < target) continue;
+		if (i < 2 * sub_half) return std::max(min, (uint64_t)i);
+		// report the highest value that is equivalent to this bucket
+		const int shift = i / sub_half - 1;
+		const uint64_t lowest = (uint64_t)(i - shift * sub_half) << shift;
+		return std::min(max, std::max<uint64_t>(min, lowest + ((uint64_t)1 << shift) - 1));
+	}
+	return max;
+}
+
+// Only taken when scenes or worker threads are added, never while timing iterations
+static std::mutex bench_mutex;
+
+// Returns the recorder's histogram for the given scene, adding it the first time the recorder sees that scene
+static int recorder_latency(bench_recorder& r, int scene_latency)
+{
+	for (unsigned i = 0; i < r.latency_index.size(); i++) if (r.latency_index[i] == scene_latency) return i;
+	r.latency.emplace_back();
+	r.latency_index.push_back(scene_latency);
+	return r.latency.size() - 1;
+}
+
+void bench_start_scene(benchmarking& b, const std::string& scene_name)
+{
+	std::lock_guard<std::mutex> lock(bench_mutex);
+	b.scene_name.push_back(scene_name);
+	b.recorder.scene = b.scene_name.size() - 1;
+	// many tests start the same scene once per frame, so reuse histograms by name
+	unsigned i = 1;
+	for (; i < b.latency.size() && b.latency[i].name != scene_name; i++) {}
+	if (i == b.latency.size()) b.latency.push_back({ scene_name, latency_histogram() });
+	b.recorder.current_latency = recorder_latency(b.recorder, i);
+}
+
+void bench_reserve(benchmarking& b, size_t iterations)
+{
+	bench_recorder& r = b.recorder;
+	if (!b.raw_results || r.samples.size() >= iterations) return;
+	if (r.written > r.samples.size()) { WLOG("Cannot grow benchmarking sample storage after it has wrapped around"); return; }
+	r.samples.resize(iterations);
+}
+
+bench_recorder& bench_thread_recorder(benchmarking& b, size_t iterations)
+{
+	std::lock_guard<std::mutex> lock(bench_mutex);
+	b.thread_recorders.emplace_back();
+	bench_recorder& r = b.thread_recorders.back();
+	if (b.raw_results) r.samples.resize(iterations);
+	r.latency_index[0] = b.recorder.latency_index[b.recorder.current_latency]; // its only histogram is for the inherited scene
+	r.scene = b.recorder.scene;
+	r.thread = b.thread_recorders.size();
+	return r;
+}
+
+static void bench_merge_samples(benchmarking& b, bench_recorder& r)
+{
+	const uint64_t stored = std::min<uint64_t>(r.written - r.merged, r.samples.size());
+	const uint64_t first = r.written - stored; // oldest sample still in the ring
+	for (uint64_t i = first; i < r.written; i++) b.results.push_back(r.samples[i % r.samples.size()]);
+	if (b.raw_results && first > r.merged) WLOG("Benchmarking sample storage of thread %d overflowed, %lu oldest raw samples dropped", r.thread, (unsigned long)(first - r.merged));
+	r.merged = r.written;
+}
+
+static void bench_merge_recorder(benchmarking& b, bench_recorder& r)
+{
+	bench_merge_samples(b, r);
+	for (unsigned i = 0; i < r.latency.size(); i++) b.latency[r.latency_index[i]].histogram.merge(r.latency[i]);
+}
+
+void bench_thread_scene(benchmarking& b, bench_recorder& r)
+{
+	std::lock_guard<std::mutex> lock(bench_mutex);
+	bench_merge_recorder(b, r); // everything so far is in the results now, so start over with one histogram
+	r.latency.assign(1, latency_histogram());
+	r.latency_index.assign(1, b.recorder.latency_index[b.recorder.current_latency]);
+	r.current_latency = 0;
+	r.scene = b.recorder.scene;
+}
+
+void bench_merge_recorders(benchmarking& b)
+{
+	std::lock_guard<std::mutex> lock(bench_mutex);
+	bench_merge_recorder(b, b.recorder);
+	for (bench_recorder& r : b.thread_recorders) bench_merge_recorder(b, r);
+	std::stable_sort(b.results.begin(), b.results.end(), [](const result_t& a, const result_t& b) { return a.start < b.start; });
+}
+
 void bench_save_results_file(const benchmarking& b)
 {
-	printf("Writing benchmarking results file (%d iterations): %s\n", (int)b.results.size(), b.results_file.c_str());
+	uint64_t iterations = 0;
+	for (const auto& s : b.latency) iterations += s.histogram.total;
+	printf("Writing benchmarking results file (%d iterations): %s\n", (int)iterations, b.results_file.c_str());
 	nlohmann::json data;
 	data["app_version"] = "1.0";
 	data["std_version"] = 1;
@@ -43,6 +173,33 @@ void bench_save_results_file(const benchmarking& b)
 	if (!b.backend_name.empty()) data["rendering_backend"] = b.backend_name;
 	data["init_time"] = b.init_time;
 	data["end_time"] = gettime();
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) // CPU time of all threads, in the same nanoseconds as above
+	{
+		data["run_info"]["user_time"] = (uint64_t)usage.ru_utime.tv_sec * 1000000000ull + (uint64_t)usage.ru_utime.tv_usec * 1000ull;
+		data["run_info"]["system_time"] = (uint64_t)usage.ru_stime.tv_sec * 1000000000ull + (uint64_t)usage.ru_stime.tv_usec * 1000ull;
+	}
+	nlohmann::json latency = nlohmann::json::array();
+	for (const auto& s : b.latency)
+	{
+		const latency_histogram& h = s.histogram;
+		if (h.total == 0) continue;
+		nlohmann::json stats;
+		if (!s.name.empty()) stats["scene"] = s.name;
+		stats["iterations"] = h.total;
+		stats["min"] = h.min;
+		stats["mean"] = h.sum / h.total;
+		stats["p50"] = h.percentile(50.0);
+		stats["p90"] = h.percentile(90.0);
+		stats["p99"] = h.percentile(99.0);
+		stats["p99.9"] = h.percentile(99.9);
+		stats["max"] = h.max;
+		latency.push_back(stats);
+		printf("\t%s: %lu iterations, p50 %lu ns, p90 %lu ns, p99 %lu ns, p99.9 %lu ns, max %lu ns\n", s.name.empty() ? "(all)" : s.name.c_str(),
+		       (unsigned long)h.total, (unsigned long)h.percentile(50.0), (unsigned long)h.percentile(90.0), (unsigned long)h.percentile(99.0),
+		       (unsigned long)h.percentile(99.9), (unsigned long)h.max);
+	}
+	data["run_info"]["latency"] = latency;
 	nlohmann::json results = nlohmann::json::array();
 	for (const auto& v : b.results)
 	{
@@ -50,24 +207,439 @@ void bench_save_results_file(const benchmarking& b)
 		if (!b.scene_name.empty())
 		{
 			result["scene"] = b.scene_name.at(v.scene);
-			if ((int)b.scene_result_file.size() >= v.scene && !b.scene_result_file.at(v.scene).empty())
+			if ((int)b.scene_result_file.size() > v.scene && !b.scene_result_file.at(v.scene).empty())
 			{
-				result["output"] = b.scene_result_file.at(v.scene);
-				result["putput_type"] = "png";
+				const std::string& output = b.scene_result_file.at(v.scene);
+				result["output"] = output;
+				result["putput_type"] = output.substr(output.find_last_of('.') + 1);
 				result["validated"] = false;
 			}
 		}
+		if (v.thread) result["thread"] = v.thread;
 		result["start_time"] = v.start;
 		result["stop_time"] = v.end;
 		result["time"] = v.end - v.start;
 		results.push_back(result);
 	}
+	if (!b.raw_results) // only write one summary entry per scene
+	{
+		for (const auto& s : b.latency)
+		{
+			if (s.histogram.total == 0) continue;
+			nlohmann::json result;
+			if (!s.name.empty()) result["scene"] = s.name;
+			result["frames"] = s.histogram.total;
+			result["time"] = s.histogram.sum;
+			results.push_back(result);
+		}
+	}
 	data["results"] = results;
 	std::ofstream file(b.results_file);
 	file << data.dump(4);
 	file.close();
 }
 
+// --- Adler-32 ---
+
+static const uint32_t ADLER_MOD = 65521;
+static const size_t ADLER_NMAX = 5552; // largest n such that 255n(n+1)/2 + (n+1)(ADLER_MOD-1) fits in 32 bits
+
+// Scalar version that only does the expensive modulo once per ADLER_NMAX bytes
+static uint32_t adler32_scalar(uint32_t adler, const unsigned char* data, size_t len)
+{
+	uint32_t a = adler & 0xffff;
+	uint32_t b = adler >> 16;
+	while (len > 0)
+	{
+		size_t n = std::min(len, ADLER_NMAX);
+		len -= n;
+		for (; n >= 8; n -= 8, data += 8)
+		{
+			a += data[0]; b += a;
+			a += data[1]; b += a;
+			a += data[2]; b += a;
+			a += data[3]; b += a;
+			a += data[4]; b += a;
+			a += data[5]; b += a;
+			a += data[6]; b += a;
+			a += data[7]; b += a;
+		}
+		for (; n > 0; n--) { a += *data++; b += a; }
+		a %= ADLER_MOD;
+		b %= ADLER_MOD;
+	}
+	return (b << 16) | a;
+}
+
+// The SIMD versions below all work on 32 byte blocks. For each block, b grows by 32 times the value of a
+// at the start of the block plus the bytes weighted 32, 31, ..., 1, while a grows by the sum of the bytes.
+// We keep a running sum of a at block starts (ps) and multiply it by 32 at the end of each ADLER_NMAX run.
+
+#if defined(__SSE2__)
+static inline uint32_t adler32_hsum_sse2(__m128i v)
+{
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
+}
+
+static uint32_t adler32_sse2(uint32_t adler, const unsigned char* data, size_t len)
+{
+	uint32_t a = adler & 0xffff;
+	uint32_t b = adler >> 16;
+	size_t blocks = len / 32;
+	len -= blocks * 32;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i tap1 = _mm_setr_epi16(32, 31, 30, 29, 28, 27, 26, 25);
+	const __m128i tap2 = _mm_setr_epi16(24, 23, 22, 21, 20, 19, 18, 17);
+	const __m128i tap3 = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+	const __m128i tap4 = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+	while (blocks > 0)
+	{
+		size_t n = std::min(blocks, ADLER_NMAX / 32);
+		blocks -= n;
+		__m128i v_ps = _mm_setr_epi32(a * n, 0, 0, 0);
+		__m128i v_s2 = _mm_setr_epi32(b, 0, 0, 0);
+		__m128i v_s1 = zero;
+		do
+		{
+			const __m128i bytes1 = _mm_loadu_si128((const __m128i*)data);
+			const __m128i bytes2 = _mm_loadu_si128((const __m128i*)(data + 16));
+			v_ps = _mm_add_epi32(v_ps, v_s1);
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+			v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpacklo_epi8(bytes1, zero), tap1));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpackhi_epi8(bytes1, zero), tap2));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpacklo_epi8(bytes2, zero), tap3));
+			v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_unpackhi_epi8(bytes2, zero), tap4));
+			data += 32;
+		} while (--n);
+		v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+		a = (a + adler32_hsum_sse2(v_s1)) % ADLER_MOD;
+		b = adler32_hsum_sse2(v_s2) % ADLER_MOD;
+	}
+	return adler32_scalar((b << 16) | a, data, len);
+}
+#endif
+
+#if HAVE_ADLER32_AVX2
+__attribute__((target("avx2"))) static uint32_t adler32_avx2(uint32_t adler, const unsigned char* data, size_t len)
+{
+	uint32_t a = adler & 0xffff;
+	uint32_t b = adler >> 16;
+	size_t blocks = len / 32;
+	len -= blocks * 32;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi16(1);
+	const __m256i tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+	                                     16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	while (blocks > 0)
+	{
+		size_t n = std::min(blocks, ADLER_NMAX / 32);
+		blocks -= n;
+		__m256i v_ps = _mm256_setr_epi32(a * n, 0, 0, 0, 0, 0, 0, 0);
+		__m256i v_s2 = _mm256_setr_epi32(b, 0, 0, 0, 0, 0, 0, 0);
+		__m256i v_s1 = zero;
+		do
+		{
+			const __m256i bytes = _mm256_loadu_si256((const __m256i*)data);
+			v_ps = _mm256_add_epi32(v_ps, v_s1);
+			v_s1 = _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes, zero));
+			v_s2 = _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, tap), ones));
+			data += 32;
+		} while (--n);
+		v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 5));
+		const __m128i s1 = _mm_add_epi32(_mm256_castsi256_si128(v_s1), _mm256_extracti128_si256(v_s1, 1));
+		const __m128i s2 = _mm_add_epi32(_mm256_castsi256_si128(v_s2), _mm256_extracti128_si256(v_s2, 1));
+		a = (a + adler32_hsum_sse2(s1)) % ADLER_MOD;
+		b = adler32_hsum_sse2(s2) % ADLER_MOD;
+	}
+	return adler32_scalar((b << 16) | a, data, len);
+}
+#endif
+
+#if defined(__ARM_NEON)
+static inline uint32_t adler32_hsum_neon(uint32x4_t v)
+{
+	uint32x2_t t = vadd_u32(vget_low_u32(v), vget_high_u32(v));
+	return vget_lane_u32(vpadd_u32(t, t), 0);
+}
+
+static uint32_t adler32_neon(uint32_t adler, const unsigned char* data, size_t len)
+{
+	static const uint16_t taps[32] = { 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+	                                   16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+	uint32_t a = adler & 0xffff;
+	uint32_t b = adler >> 16;
+	size_t blocks = len / 32;
+	len -= blocks * 32;
+	while (blocks > 0)
+	{
+		size_t n = std::min(blocks, ADLER_NMAX / 32);
+		blocks -= n;
+		uint32x4_t v_ps = vsetq_lane_u32(a * n, vdupq_n_u32(0), 0);
+		uint32x4_t v_s1 = vdupq_n_u32(0);
+		// per column byte sums, cannot overflow since n <= ADLER_NMAX / 32
+		uint16x8_t col1 = vdupq_n_u16(0);
+		uint16x8_t col2 = vdupq_n_u16(0);
+		uint16x8_t col3 = vdupq_n_u16(0);
+		uint16x8_t col4 = vdupq_n_u16(0);
+		do
+		{
+			const uint8x16_t bytes1 = vld1q_u8(data);
+			const uint8x16_t bytes2 = vld1q_u8(data + 16);
+			v_ps = vaddq_u32(v_ps, v_s1);
+			v_s1 = vpadalq_u16(v_s1, vpadalq_u8(vpaddlq_u8(bytes1), bytes2));
+			col1 = vaddw_u8(col1, vget_low_u8(bytes1));
+			col2 = vaddw_u8(col2, vget_high_u8(bytes1));
+			col3 = vaddw_u8(col3, vget_low_u8(bytes2));
+			col4 = vaddw_u8(col4, vget_high_u8(bytes2));
+			data += 32;
+		} while (--n);
+		uint32x4_t v_s2 = vshlq_n_u32(v_ps, 5);
+		v_s2 = vmlal_u16(v_s2, vget_low_u16(col1), vld1_u16(taps + 0));
+		v_s2 = vmlal_u16(v_s2, vget_high_u16(col1), vld1_u16(taps + 4));
+		v_s2 = vmlal_u16(v_s2, vget_low_u16(col2), vld1_u16(taps + 8));
+		v_s2 = vmlal_u16(v_s2, vget_high_u16(col2), vld1_u16(taps + 12));
+		v_s2 = vmlal_u16(v_s2, vget_low_u16(col3), vld1_u16(taps + 16));
+		v_s2 = vmlal_u16(v_s2, vget_high_u16(col3), vld1_u16(taps + 20));
+		v_s2 = vmlal_u16(v_s2, vget_low_u16(col4), vld1_u16(taps + 24));
+		v_s2 = vmlal_u16(v_s2, vget_high_u16(col4), vld1_u16(taps + 28));
+		a = (a + adler32_hsum_neon(v_s1)) % ADLER_MOD;
+		b = (b + adler32_hsum_neon(v_s2)) % ADLER_MOD;
+	}
+	return adler32_scalar((b << 16) | a, data, len);
+}
+#endif
+
+bool adler32_supported(adler32_impl impl)
+{
+	switch (impl)
+	{
+	case ADLER32_SCALAR: return true;
+#if defined(__SSE2__)
+	case ADLER32_SSE2: return true;
+#endif
+#if HAVE_ADLER32_AVX2
+	case ADLER32_AVX2: __builtin_cpu_init(); return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON)
+	case ADLER32_NEON: return true;
+#endif
+	default: return false;
+	}
+}
+
+const char* adler32_name(adler32_impl impl)
+{
+	switch (impl)
+	{
+	case ADLER32_SCALAR: return "scalar";
+	case ADLER32_SSE2: return "sse2";
+	case ADLER32_AVX2: return "avx2";
+	case ADLER32_NEON: return "neon";
+	default: return "unknown";
+	}
+}
+
+uint32_t adler32_with(adler32_impl impl, const unsigned char* data, size_t len, uint32_t adler)
+{
+	switch (impl)
+	{
+	case ADLER32_SCALAR: return adler32_scalar(adler, data, len);
+#if defined(__SSE2__)
+	case ADLER32_SSE2: return adler32_sse2(adler, data, len);
+#endif
+#if HAVE_ADLER32_AVX2
+	case ADLER32_AVX2: return adler32_avx2(adler, data, len);
+#endif
+#if defined(__ARM_NEON)
+	case ADLER32_NEON: return adler32_neon(adler, data, len);
+#endif
+	default: ABORT("Adler-32 implementation %s not available in this build", adler32_name(impl));
+	}
+}
+
+static adler32_impl adler32_best()
+{
+	if (adler32_supported(ADLER32_AVX2)) return ADLER32_AVX2;
+	if (adler32_supported(ADLER32_NEON)) return ADLER32_NEON;
+	if (adler32_supported(ADLER32_SSE2)) return ADLER32_SSE2;
+	return ADLER32_SCALAR;
+}
+
+uint32_t adler32(const unsigned char* data, size_t len, uint32_t adler)
+{
+	static const adler32_impl best = adler32_best();
+	return adler32_with(best, data, len, adler);
+}
+
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2)
+{
+	const uint64_t rem = len2 % ADLER_MOD;
+	uint64_t sum1 = adler1 & 0xffff;
+	uint64_t sum2 = (rem * sum1) % ADLER_MOD;
+	sum1 += (adler2 & 0xffff) + ADLER_MOD - 1;
+	sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_MOD - rem;
+	if (sum1 >= ADLER_MOD) sum1 -= ADLER_MOD;
+	if (sum1 >= ADLER_MOD) sum1 -= ADLER_MOD;
+	if (sum2 >= 2 * ADLER_MOD) sum2 -= 2 * ADLER_MOD;
+	if (sum2 >= ADLER_MOD) sum2 -= ADLER_MOD;
+	return (uint32_t)(sum1 | (sum2 << 16));
+}
+
+chunked_checksum::chunked_checksum(size_t chunk_size, unsigned threads) : m_chunk_size(chunk_size)
+{
+	assert(chunk_size > 0);
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned i = 1; i < threads; i++) m_threads.emplace_back(&chunked_checksum::worker, this); // calling thread also helps
+}
+
+chunked_checksum::~chunked_checksum()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& t : m_threads) t.join();
+}
+
+void chunked_checksum::worker()
+{
+	set_thread_name("checksum");
+	std::unique_lock<std::mutex> lock(m_mutex);
+	uint64_t seen = 0;
+	while (true)
+	{
+		m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+		if (m_stop) return;
+		seen = m_generation;
+		lock.unlock();
+		run_jobs();
+		lock.lock();
+		if (++m_finished == m_threads.size()) m_done.notify_one();
+	}
+}
+
+void chunked_checksum::run_jobs()
+{
+	for (size_t i = m_next++; i < m_jobs.size(); i = m_next++)
+	{
+		const size_t chunk = m_jobs[i];
+		const size_t offset = chunk * m_chunk_size;
+		m_digests[chunk] = adler32(m_data + offset, std::min(m_chunk_size, m_size - offset));
+	}
+}
+
+void chunked_checksum::hash_chunks()
+{
+	m_jobs.clear();
+	for (size_t i = 0; i < m_dirty.size(); i++) if (m_dirty[i]) m_jobs.push_back(i);
+	m_dirty.assign(m_dirty.size(), false);
+	if (m_jobs.size() <= 1 || m_threads.empty()) // not worth waking up the pool
+	{
+		m_next = 0;
+		run_jobs();
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_next = 0;
+		m_finished = 0;
+		m_generation++;
+	}
+	m_wake.notify_all();
+	run_jobs();
+	// wait for every worker to finish this generation, so that none of them is still looking at m_jobs
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [&] { return m_finished == m_threads.size(); });
+}
+
+uint32_t chunked_checksum::combine() const
+{
+	uint32_t adler = 1;
+	for (size_t i = 0; i < m_digests.size(); i++) adler = adler32_combine(adler, m_digests[i], std::min(m_chunk_size, m_size - i * m_chunk_size));
+	return adler;
+}
+
+uint32_t chunked_checksum::checksum(const unsigned char* data, size_t size)
+{
+	m_data = data;
+	m_size = size;
+	const size_t chunks = (size + m_chunk_size - 1) / m_chunk_size;
+	m_digests.assign(chunks, 1);
+	m_dirty.assign(chunks, true);
+	hash_chunks();
+	return combine();
+}
+
+void chunked_checksum::mark_dirty(size_t offset, size_t size)
+{
+	if (size == 0 || offset >= m_size) return;
+	const size_t last = std::min(offset + size, m_size) - 1;
+	for (size_t i = offset / m_chunk_size; i <= last / m_chunk_size; i++) m_dirty[i] = true;
+}
+
+uint32_t chunked_checksum::update()
+{
+	hash_chunks();
+	return combine();
+}
+
+async_writer::~async_writer()
+{
+	if (!m_thread.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	m_thread.join(); // runs the remaining jobs first
+}
+
+void async_writer::enqueue(std::function<void()> job)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (!m_thread.joinable()) m_thread = std::thread(&async_writer::worker, this);
+	m_done.wait(lock, [&] { return m_jobs.size() < m_depth; });
+	m_jobs.push_back(std::move(job));
+	lock.unlock();
+	m_wake.notify_one();
+}
+
+void async_writer::flush()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [&] { return m_jobs.empty() && !m_busy; });
+}
+
+void async_writer::worker()
+{
+	set_thread_name("writer");
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_wake.wait(lock, [&] { return m_stop || !m_jobs.empty(); });
+		if (m_jobs.empty()) return; // only stop once everything is written
+		std::function<void()> job = std::move(m_jobs.front());
+		m_jobs.pop_front();
+		m_busy = true;
+		lock.unlock();
+		m_done.notify_all(); // room in the queue
+		job();
+		lock.lock();
+		m_busy = false;
+		m_done.notify_all();
+	}
+}
+
+async_writer& async_image_writer()
+{
+	static async_writer writer(get_env_int("TOOLSTEST_IMAGE_QUEUE", 4));
+	return writer;
+}
+
 void set_thread_name(const char* name)
 {
 	// "length is restricted to 16 characters, including the terminating null byte"
@@ -148,7 +720,7 @@ bool exists_blob(const std::string& filename)
 	return (r == 0 && st.st_size > 0);
 }
 
-char* load_blob(const std::string& filename, uint32_t* size)
+char* load_blob(const std::string& filename, size_t* size)
 {
 	FILE* fp = fopen(filename.c_str(), "rb");
 	if (!fp)
@@ -159,23 +731,86 @@ char* load_blob(const std::string& filename, uint32_t* size)
 	int r = fstat(fileno(fp), &st);
 	if (r != 0) ABORT("Could not stat \"%s\": %s", filename.c_str(), strerror(errno));
 	if (st.st_size == 0) ABORT("Trying to load blob of size zero!");
-	char* blob = (char*)malloc(st.st_size);
+	char* blob = (char*)malloc(st.st_size + 1);
 	r = fread(blob, st.st_size, 1, fp);
-	if (r != 1) ABORT("Could not read \"%s\" (size %d, returned %d): %s", filename.c_str(), (int)st.st_size, r, strerror(errno));
+	if (r != 1) ABORT("Could not read \"%s\" (size %lu, returned %d): %s", filename.c_str(), (unsigned long)st.st_size, r, strerror(errno));
 	fclose(fp);
+	blob[st.st_size] = '\0';
 	*size = st.st_size;
 	return blob;
 }
 
-void save_blob(const std::string& filename, const char* data, uint32_t size)
+void save_blob(const std::string& filename, const char* data, size_t size)
 {
 	if (size == 0) ABORT("Trying to save blob of size zero!");
-	FILE* fp = fopen(filename.c_str(), "wb");
-	if (!fp)
+	blob_writer writer(filename);
+	writer.write(data, size);
+}
+
+mapped_blob& mapped_blob::operator=(mapped_blob&& other)
+{
+	if (this == &other) return *this;
+	close();
+	m_data = other.m_data;
+	m_size = other.m_size;
+	m_fd = other.m_fd;
+	other.m_data = nullptr;
+	other.m_size = 0;
+	other.m_fd = -1;
+	return *this;
+}
+
+void mapped_blob::open(const std::string& filename, int flags)
+{
+	close();
+	m_fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (m_fd == -1) ABORT("Cannot open \"%s\": %s", filename.c_str(), strerror(errno));
+	struct stat st;
+	if (fstat(m_fd, &st) != 0) ABORT("Could not stat \"%s\": %s", filename.c_str(), strerror(errno));
+	if (st.st_size == 0) ABORT("Trying to load blob of size zero!");
+	m_size = st.st_size;
+	int mmap_flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+	if (flags & POPULATE) mmap_flags |= MAP_POPULATE;
+#endif
+	void* ptr = mmap(nullptr, m_size, PROT_READ, mmap_flags, m_fd, 0);
+	if (ptr == MAP_FAILED) ABORT("Could not map \"%s\" (size %lu): %s", filename.c_str(), (unsigned long)m_size, strerror(errno));
+	if (flags & SEQUENTIAL) madvise(ptr, m_size, MADV_SEQUENTIAL);
+	m_data = (const char*)ptr;
+}
+
+void mapped_blob::close()
+{
+	if (m_data) munmap((void*)m_data, m_size);
+	if (m_fd != -1) ::close(m_fd);
+	m_data = nullptr;
+	m_size = 0;
+	m_fd = -1;
+}
+
+blob_writer::blob_writer(const std::string& filename) : m_filename(filename)
+{
+	m_fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (m_fd == -1) ABORT("Cannot open \"%s\": %s", filename.c_str(), strerror(errno));
+}
+
+void blob_writer::write(const char* data, size_t size)
+{
+	assert(m_fd != -1);
+	while (size > 0)
 	{
-		ABORT("Cannot open \"%s\": %s", filename.c_str(), strerror(errno));
+		ssize_t r = ::write(m_fd, data, size);
+		if (r == -1 && errno == EINTR) continue;
+		if (r <= 0) ABORT("Could not write \"%s\" (size %lu at offset %lu): %s", m_filename.c_str(), (unsigned long)size, (unsigned long)m_written, strerror(errno));
+		data += r;
+		size -= r;
+		m_written += r;
 	}
-	int r = fwrite(data, size, 1, fp);
-	if (r != 1) ABORT("Could not write \"%s\" (size %d, returned %d): %s", filename.c_str(), (int)size, r, strerror(errno));
-	fclose(fp);
+}
+
+void blob_writer::close()
+{
+	if (m_fd == -1) return;
+	if (::close(m_fd) != 0) ABORT("Could not close \"%s\": %s", m_filename.c_str(), strerror(errno));
+	m_fd = -1;
 }
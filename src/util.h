@@ -15,10 +15,23 @@
 #include <vector>
 #include <string>
 #include <stdint.h>
+#include <algorithm>
+#include <list>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
 
 /// Implement support for naming threads, missing from c++11
 void set_thread_name(const char* name);
 
+int get_env_int(const char* name, int fallback);
+
+/// Resident set size of this process in kilobytes, or zero if it cannot be read
+long get_rss();
+
 extern uint_fast8_t p__loops;
 extern uint_fast8_t p__sanity;
 extern uint_fast8_t p__debug_level;
@@ -59,7 +72,8 @@ int STOI(const std::string& value);
 
 #else // !ANDROID
 
-static __attribute__((pure)) inline uint32_t adler32(unsigned char *data, size_t len)
+/// Straightforward scalar Adler-32, kept as the reference for validating the optimized adler32()
+static __attribute__((pure)) inline uint32_t adler32_reference(const unsigned char *data, size_t len)
 {
 	const uint32_t MOD_ADLER = 65521;
 	uint32_t a = 1, b = 0;
@@ -103,6 +117,92 @@ static __attribute__((pure)) inline uint64_t gettime()
 
 #endif
 
+/// Adler-32 checksum using the fastest implementation available on the running CPU. To checksum
+/// data in several calls, pass the return value of the previous call as adler.
+uint32_t adler32(const unsigned char* data, size_t len, uint32_t adler = 1);
+
+/// The Adler-32 implementations that adler32() chooses from, for testing them against each other
+enum adler32_impl { ADLER32_SCALAR, ADLER32_SSE2, ADLER32_AVX2, ADLER32_NEON, ADLER32_IMPL_COUNT };
+bool adler32_supported(adler32_impl impl);
+const char* adler32_name(adler32_impl impl);
+uint32_t adler32_with(adler32_impl impl, const unsigned char* data, size_t len, uint32_t adler = 1);
+
+/// Combine the Adler-32 checksums of two consecutive pieces of data, where len2 is the length of the second
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2);
+
+/// Checksum service for large buffers. Splits the memory into chunks that are hashed in parallel on a small
+/// thread pool, then combines the partial checksums. The per-chunk digests are kept, so that after a partial
+/// write only the chunks marked dirty need to be hashed again.
+class chunked_checksum
+{
+public:
+	/// A thread count of zero means one thread per CPU core
+	chunked_checksum(size_t chunk_size = 4 * 1024 * 1024, unsigned threads = 0);
+	~chunked_checksum();
+
+	/// Hash all of the given memory, which also becomes the tracked range for update()
+	uint32_t checksum(const unsigned char* data, size_t size);
+	/// Mark a byte range of the tracked memory as changed
+	void mark_dirty(size_t offset, size_t size);
+	/// Rehash the dirty chunks of the tracked memory and return the checksum of all of it
+	uint32_t update();
+
+	const std::vector<uint32_t>& digests() const { return m_digests; }
+	size_t chunk_size() const { return m_chunk_size; }
+
+private:
+	void hash_chunks();
+	void run_jobs();
+	void worker();
+	uint32_t combine() const;
+
+	const size_t m_chunk_size;
+	const unsigned char* m_data = nullptr;
+	size_t m_size = 0;
+	std::vector<uint32_t> m_digests;
+	std::vector<bool> m_dirty;
+
+	// thread pool; m_jobs is only changed while all workers are idle
+	std::vector<std::thread> m_threads;
+	std::vector<size_t> m_jobs; // chunk indices to hash
+	std::atomic<size_t> m_next { 0 }; // next index into m_jobs to take
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	uint64_t m_generation = 0;
+	unsigned m_finished = 0;
+	bool m_stop = false;
+};
+
+/// Runs jobs like image encoding and file writing on a background thread, so that the rendering thread
+/// does not stall on them. At most 'depth' jobs are queued, beyond that enqueue() waits for room.
+class async_writer
+{
+public:
+	async_writer(size_t depth) : m_depth(std::max<size_t>(depth, 1)) {}
+	~async_writer();
+
+	/// The job must own all data it needs, as it runs after the call returns
+	void enqueue(std::function<void()> job);
+	/// Wait until all queued jobs are done
+	void flush();
+
+private:
+	void worker();
+
+	const size_t m_depth;
+	std::deque<std::function<void()>> m_jobs;
+	bool m_busy = false;
+	bool m_stop = false;
+	std::thread m_thread; // started on first enqueue()
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+};
+
+/// Shared writer for saved test images, queue depth from TOOLSTEST_IMAGE_QUEUE (default 4). Flushed in bench_done().
+async_writer& async_image_writer();
+
 // Another weird android issue...
 #if defined(ANDROID) && !defined(UINT32_MAX)
 #define UINT32_MAX (4294967295U)
@@ -114,12 +214,76 @@ struct result_t
 	uint64_t start;
 	uint64_t end;
 	int scene;
+	int thread;
 };
+
+/// HDR-style latency histogram. Values below 2^sub_bits get one bucket each, above that every power
+/// of two is split into 2^(sub_bits-1) linear sub-buckets, giving a worst case relative error of
+/// about 1.6% over the full 64 bit range in a fixed amount of memory.
+struct latency_histogram
+{
+	static const int sub_bits = 7;
+	static const int sub_half = 1 << (sub_bits - 1);
+	static const int bucket_count = (64 - sub_bits + 2) * sub_half;
+
+	std::vector<uint64_t> counts = std::vector<uint64_t>(bucket_count, 0);
+	uint64_t total = 0;
+	uint64_t sum = 0;
+	uint64_t min = UINT64_MAX;
+	uint64_t max = 0;
+
+	static inline int bucket(uint64_t value)
+	{
+		const int msb = 63 - __builtin_clzll(value | 1);
+		const int shift = std::max<int>(0, msb - sub_bits + 1);
+		return (shift == 0) ? (int)value : shift * sub_half + (int)(value >> shift);
+	}
+
+	inline void record(uint64_t value)
+	{
+		counts[bucket(value)]++;
+		total++;
+		sum += value;
+		min = std::min(min, value);
+		max = std::max(max, value);
+	}
+
+	/// Merge samples from another histogram into this one
+	void merge(const latency_histogram& other);
+	/// Returns the value at the given percentile (0-100), clamped to the recorded min/max
+	uint64_t percentile(double p) const;
+};
+
+struct scene_latency
+{
+	std::string name;
+	latency_histogram histogram;
+};
+
+/// Fixed-capacity, preallocated store for the iteration timings of one thread. Only its owning thread
+/// writes to it, so recording an iteration takes no locks and does no allocations. Raw samples wrap
+/// around once the capacity is used up, while the latency histograms keep counting every iteration.
+struct bench_recorder
+{
+	std::vector<result_t> samples; // ring of raw samples, empty if raw results are disabled
+	uint64_t written = 0; // total number of samples recorded, may exceed samples.size()
+	std::vector<latency_histogram> latency = std::vector<latency_histogram>(1); // only for the scenes this thread has timed
+	std::vector<int> latency_index = { 0 }; // index into benchmarking::latency for each of the above
+	int current_latency = 0; // index into latency for the current scene
+	int scene = 0; // index into benchmarking::scene_name for the current scene
+	int thread = 0; // zero for the main thread, otherwise in order of registration
+	uint64_t merged = 0; // samples already moved into benchmarking::results
+	uint64_t latest_time = 0; // to track start of latest iteration
+};
+
 struct benchmarking
 {
-	std::vector<result_t> results; // store all results
+	bench_recorder recorder; // iterations recorded from the main thread
+	std::list<bench_recorder> thread_recorders; // iterations recorded from worker threads
+	std::vector<result_t> results; // all raw samples, merged from the recorders in bench_done()
+	bool raw_results = true; // whether to store and write out each individual iteration
+	std::vector<scene_latency> latency = { { std::string(), latency_histogram() } }; // one per unique scene name, first one for iterations outside any scene
 	uint64_t init_time = 0; // to track start of whole run
-	uint64_t latest_time = 0; // if we need it, to track start of latest iteration
 	char* enable_file = nullptr; // copy of the enable file for the results file
 	std::string test_name;
 	std::string results_file; // path to results file
@@ -129,20 +293,43 @@ struct benchmarking
 };
 
 void bench_save_results_file(const benchmarking& b);
+void bench_start_scene(benchmarking& b, const std::string& scene_name);
+/// Make room for the given number of raw samples from the main thread. Call before starting to time.
+void bench_reserve(benchmarking& b, size_t iterations);
+/// Register a recorder for a worker thread with room for the given number of raw samples. Call this before
+/// the worker's timed loop, then time iterations with the recorder instead of the benchmarking struct. The
+/// worker inherits the current scene. All recorders are merged into the results in bench_done().
+bench_recorder& bench_thread_recorder(benchmarking& b, size_t iterations);
+/// Move a worker recorder into the current scene, after merging what it has recorded so far into the
+/// results, so that a worker running several scenes can reuse one recorder sized for a single scene.
+/// Only call this while the worker is not timing iterations.
+void bench_thread_scene(benchmarking& b, bench_recorder& r);
+/// Merge all recorders into results and latency histograms; called from bench_done()
+void bench_merge_recorders(benchmarking& b);
 static inline void bench_init(benchmarking& b, const char* test_name, char* enable_file, const char* results_file)
 {
 	b.test_name = test_name;
 	b.init_time = gettime();
 	b.enable_file = enable_file;
 	b.results_file = results_file;
+	b.raw_results = get_env_int("TOOLSTEST_RAW_RESULTS", 1);
+	bench_reserve(b, std::max<int>(p__loops, get_env_int("TOOLSTEST_TIMES", 10)));
 }
 static inline void bench_done(benchmarking& b)
 {
-	if (b.enable_file) { bench_save_results_file(b); free(b.enable_file); }
+	async_image_writer().flush(); // results may refer to images still being written
+	if (b.enable_file) { bench_merge_recorders(b); bench_save_results_file(b); free(b.enable_file); }
 }
-static inline void bench_start_iteration(benchmarking& b) { b.latest_time = gettime(); }
-static inline void bench_stop_iteration(benchmarking& b) { b.results.push_back({ b.latest_time, gettime(), std::max<int>(0, (int)b.scene_name.size() - 1) }); }
-static inline void bench_start_scene(benchmarking& b, const std::string& scene_name) { b.scene_name.push_back(scene_name); }
+static inline void bench_start_iteration(bench_recorder& r) { r.latest_time = gettime(); }
+static inline void bench_stop_iteration(bench_recorder& r)
+{
+	const uint64_t end = gettime();
+	r.latency[r.current_latency].record(end - r.latest_time);
+	if (!r.samples.empty()) r.samples[r.written % r.samples.size()] = { r.latest_time, end, r.scene, r.thread };
+	r.written++;
+}
+static inline void bench_start_iteration(benchmarking& b) { bench_start_iteration(b.recorder); }
+static inline void bench_stop_iteration(benchmarking& b) { bench_stop_iteration(b.recorder); }
 static inline void bench_stop_scene(benchmarking& b, const std::string& filename = std::string()) { b.scene_result_file.push_back(filename); }
 
 static inline bool is_debug() { return p__debug_level; }
@@ -151,10 +338,63 @@ bool match(const char* in, const char* short_form, const char* long_form);
 int get_arg(char** in, int i, int argc);
 const char* get_string_arg(char** in, int i, int argc);
 void usage();
-char* load_blob(const std::string& filename, uint32_t* size);
-void save_blob(const std::string& filename, const char* data, uint32_t size);
+/// Loads a whole file into a malloc'ed buffer, which is zero terminated for convenience
+char* load_blob(const std::string& filename, size_t* size);
+void save_blob(const std::string& filename, const char* data, size_t size);
 bool exists_blob(const std::string& filename);
 
-int get_env_int(const char* name, int fallback);
+/// Read-only memory mapping of a whole file, unmapped when destroyed. Large blobs can be used
+/// this way without first copying them onto the heap. Aborts on errors, like load_blob().
+class mapped_blob
+{
+public:
+	enum flags
+	{
+		NONE = 0,
+		SEQUENTIAL = 1, // advise the kernel that we read it front to back
+		POPULATE = 2, // prefault the whole file when mapping it
+	};
+
+	mapped_blob() {}
+	mapped_blob(const std::string& filename, int flags = NONE) { open(filename, flags); }
+	mapped_blob(const mapped_blob&) = delete;
+	mapped_blob& operator=(const mapped_blob&) = delete;
+	mapped_blob(mapped_blob&& other) { *this = std::move(other); }
+	mapped_blob& operator=(mapped_blob&& other);
+	~mapped_blob() { close(); }
+
+	void open(const std::string& filename, int flags = NONE);
+	void close();
+
+	const char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	int fd() const { return m_fd; }
+
+private:
+	const char* m_data = nullptr;
+	size_t m_size = 0;
+	int m_fd = -1;
+};
+
+/// Streaming writer for large blobs, written in as many pieces as needed without size limits.
+/// Aborts on errors, like save_blob().
+class blob_writer
+{
+public:
+	blob_writer(const std::string& filename);
+	blob_writer(const blob_writer&) = delete;
+	blob_writer& operator=(const blob_writer&) = delete;
+	~blob_writer() { close(); }
+
+	void write(const char* data, size_t size);
+	void close();
+
+	size_t size() const { return m_written; }
+
+private:
+	std::string m_filename;
+	int m_fd = -1;
+	size_t m_written = 0;
+};
 
 static __attribute__((const)) inline uint64_t aligned_size(uint64_t size, uint64_t alignment) { return size + alignment - 1ull - (size + alignment - 1ull) % alignment; }
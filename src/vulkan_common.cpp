@@ -1,6 +1,7 @@
 #include "vulkan_common.h"
 #include "external/json.hpp"
 #include <fstream>
+#include <algorithm>
 #include <spirv/unified1/spirv.h>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -110,7 +111,7 @@ static bool check_bench(vulkan_setup_t& vulkan, vulkan_req_t& reqs, const char*
 	if (enable_path)
 	{
 		printf("Reading benchmarking enable file: %s\n", enable_path);
-		uint32_t size = 0;
+		size_t size = 0;
 		content = load_blob(enable_path, &size);
 	}
 	else if (enable_json)
@@ -299,7 +300,11 @@ vulkan_setup_t test_init(int argc, char** argv, const std::string& testname, vul
 		}
 		if (wsi && strcmp(wsi, "headless") == 0)
 		{
-			enabledExtensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+			// the test may already have asked for it
+			if (std::find(reqs.instance_extensions.begin(), reqs.instance_extensions.end(), VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME) == reqs.instance_extensions.end())
+			{
+				enabledExtensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+			}
 		}
 #ifdef VK_USE_PLATFORM_XCB_KHR
 		else
@@ -398,7 +403,11 @@ vulkan_setup_t test_init(int argc, char** argv, const std::string& testname, vul
 	vkGetPhysicalDeviceQueueFamilyProperties(vulkan.physical, &family_count, nullptr);
 	std::vector<VkQueueFamilyProperties> familyprops(family_count);
 	vkGetPhysicalDeviceQueueFamilyProperties(vulkan.physical, &family_count, familyprops.data());
-	if (familyprops[0].queueCount < reqs.queues)
+	if (familyprops[0].queueCount < reqs.queues && reqs.fewer_queues_ok)
+	{
+		reqs.queues = familyprops[0].queueCount;
+	}
+	else if (familyprops[0].queueCount < reqs.queues)
 	{
 		printf("Vulkan implementation does not have sufficient queues (only %d, need %u) for this test\n", familyprops[0].queueCount, reqs.queues);
 		exit(77);
@@ -767,23 +776,47 @@ const char* errorString(const VkResult errorCode)
 	}
 }
 
-/// Takes an RGBA8888 image and saves it to disk as PNG
-void test_save_image(const vulkan_setup_t& vulkan, const char* filename, VkDeviceMemory memory, uint32_t offset, uint32_t width, uint32_t height)
+std::string test_save_image(const vulkan_setup_t& vulkan, const char* filename, VkDeviceMemory memory, uint32_t offset, uint32_t width, uint32_t height)
 {
+	std::string name = filename;
+	const char* format = getenv("TOOLSTEST_IMAGE_FORMAT");
+	if (format)
+	{
+		if (strcmp(format, "png") != 0 && strcmp(format, "ppm") != 0 && strcmp(format, "raw") != 0) ABORT("Unsupported TOOLSTEST_IMAGE_FORMAT \"%s\", must be png, ppm or raw", format);
+		name = name.substr(0, name.find_last_of('.')) + "." + format;
+	}
+	const std::string extension = name.substr(name.find_last_of('.') + 1);
+
 	float* ptr = nullptr;
 	const uint32_t size = width * height * 4;
 	VkResult result = vkMapMemory(vulkan.device, memory, offset, size * sizeof(float), 0, (void**)&ptr);
 	check(result);
 	assert(ptr != nullptr);
-	std::vector<unsigned char> image;
-	image.reserve(size);
-	for (unsigned i = 0; i < size; i++)
-	{
-		image.push_back((unsigned char)(255.0f * ptr[i]));
-	}
-	int r = stbi_write_png(filename, width, height, 4, image.data(), 0);
-	assert(r != 0);
+	std::vector<float> pixels(ptr, ptr + size); // memory may be reused as soon as we return
 	vkUnmapMemory(vulkan.device, memory);
+
+	async_image_writer().enqueue([name, extension, pixels = std::move(pixels), width, height]()
+	{
+		const bool ppm = (extension == "ppm");
+		const unsigned channels = ppm ? 3 : 4;
+		const std::string header = ppm ? "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n" : std::string();
+		std::vector<unsigned char> image(header.begin(), header.end());
+		image.reserve(header.size() + width * height * channels);
+		for (unsigned i = 0; i < pixels.size(); i++)
+		{
+			if (ppm && i % 4 == 3) continue; // no alpha in PPM
+			image.push_back((unsigned char)(255.0f * pixels[i]));
+		}
+		if (ppm || extension == "raw")
+		{
+			save_blob(name, (const char*)image.data(), image.size());
+		}
+		else if (stbi_write_png(name.c_str(), width, height, 4, image.data(), 0) == 0)
+		{
+			ABORT("Failed to write image %s", name.c_str());
+		}
+	});
+	return name;
 }
 
 void testCmdCopyBuffer(const vulkan_setup_t& vulkan, VkCommandBuffer cmdbuf, const std::vector<VkBuffer>& origin, const std::vector<VkBuffer>& target, VkDeviceSize size)
@@ -979,6 +1012,18 @@ void testFlushMemory(const vulkan_setup_t& vulkan, VkDeviceMemory memory, VkDevi
 	check(result);
 }
 
+uint32_t testChecksumMemory(const vulkan_setup_t& vulkan, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size)
+{
+	static chunked_checksum service; // thread pool is created on first use
+	unsigned char* data = nullptr;
+	if (size == VK_WHOLE_SIZE) ABORT("Memory size must be given explicitly for checksumming");
+	VkResult result = vkMapMemory(vulkan.device, memory, offset, size, 0, (void**)&data);
+	check(result);
+	const uint32_t adler = service.checksum(data, size);
+	vkUnmapMemory(vulkan.device, memory);
+	return adler;
+}
+
 void testCopyBuffer(const vulkan_setup_t& vulkan, VkQueue queue, VkBuffer target, VkBuffer origin, VkDeviceSize size)
 {
 	VkCommandPool command_pool;
@@ -59,6 +59,7 @@ struct vulkan_req_t // Vulkan context requirements
 	uint32_t minApiVersion = VK_API_VERSION_1_0; // the minimum required for the test
 	uint32_t maxApiVersion = VK_API_VERSION_1_4; // the maximum allowed for the test
 	uint32_t queues = 1;
+	bool fewer_queues_ok = false; // create as many as the queue family has instead of skipping the test, and update queues to match
 	std::vector<std::string> instance_extensions;
 	std::vector<std::string> device_extensions;
 	bool samplerAnisotropy = false;
@@ -164,6 +165,9 @@ void testCmdCopyBuffer(const vulkan_setup_t& vulkan, VkCommandBuffer cmdbuf, con
 void testFreeMemory(const vulkan_setup_t& vulkan, VkDeviceMemory memory);
 void testFlushMemory(const vulkan_setup_t& vulkan, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size, bool extra);
 
+/// Checksum a range of host visible memory on multiple threads. The memory must not already be mapped.
+uint32_t testChecksumMemory(const vulkan_setup_t& vulkan, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size);
+
 /// Adds a dummy queue submit with a pipeline barrier that references the passed buffers in order to make tools not ignore them.
 void testQueueBuffer(const vulkan_setup_t& vulkan, VkQueue queue, const std::vector<VkBuffer>& buffers);
 
@@ -173,8 +177,10 @@ void testCopyBuffer(const vulkan_setup_t& vulkan, VkQueue queue, VkBuffer target
 /// Select which GPU to use
 void select_gpu(int chosen_gpu);
 
-/// Takes an RGBA8888 image and saves it to disk as PNG
-void test_save_image(const vulkan_setup_t& vulkan, const char* filename, VkDeviceMemory memory, uint32_t offset, uint32_t width, uint32_t height);
+/// Takes an RGBA float image and saves it to disk as PNG, or as PPM or raw RGBA8888 if the file name
+/// ends in .ppm or .raw, or if TOOLSTEST_IMAGE_FORMAT says so. The pixels are copied out right away, the
+/// encoding and writing happens on async_image_writer(). Returns the name of the file written.
+std::string test_save_image(const vulkan_setup_t& vulkan, const char* filename, VkDeviceMemory memory, uint32_t offset, uint32_t width, uint32_t height);
 
 bool enable_frame_boundary(vulkan_req_t& reqs);
 
@@ -64,34 +64,42 @@ int main(int argc, char** argv)
         result = vkCreateDescriptorSetLayout(vulkan.device, &descriptorSetLayoutCreateInfo, nullptr, &r.descriptorSetLayout);
 	check(result);
 
+	// One descriptor set for each frame in flight, each pointing to its own output buffer
+	const uint32_t slots = r.buffers.size();
 	VkDescriptorPoolSize descriptorPoolSize = {};
 	descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	descriptorPoolSize.descriptorCount = 1;
+	descriptorPoolSize.descriptorCount = slots;
 	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, nullptr };
-	descriptorPoolCreateInfo.maxSets = 1;
+	descriptorPoolCreateInfo.maxSets = slots;
 	descriptorPoolCreateInfo.poolSizeCount = 1;
 	descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
 	result = vkCreateDescriptorPool(vulkan.device, &descriptorPoolCreateInfo, nullptr, &r.descriptorPool);
 	check(result);
 
+	std::vector<VkDescriptorSetLayout> layouts(slots, r.descriptorSetLayout);
+	r.descriptorSets.resize(slots);
 	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, nullptr };
 	descriptorSetAllocateInfo.descriptorPool = r.descriptorPool;
-	descriptorSetAllocateInfo.descriptorSetCount = 1;
-	descriptorSetAllocateInfo.pSetLayouts = &r.descriptorSetLayout;
-	result = vkAllocateDescriptorSets(vulkan.device, &descriptorSetAllocateInfo, &r.descriptorSet);
+	descriptorSetAllocateInfo.descriptorSetCount = slots;
+	descriptorSetAllocateInfo.pSetLayouts = layouts.data();
+	result = vkAllocateDescriptorSets(vulkan.device, &descriptorSetAllocateInfo, r.descriptorSets.data());
 	check(result);
+	r.descriptorSet = r.descriptorSets.at(0);
 
-	VkDescriptorBufferInfo descriptorBufferInfo = {};
-	descriptorBufferInfo.buffer = r.buffer;
-	descriptorBufferInfo.offset = 0;
-	descriptorBufferInfo.range = r.buffer_size;
-	VkWriteDescriptorSet writeDescriptorSet = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
-	writeDescriptorSet.dstSet = r.descriptorSet;
-	writeDescriptorSet.dstBinding = 0;
-	writeDescriptorSet.descriptorCount = 1;
-	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
-	vkUpdateDescriptorSets(vulkan.device, 1, &writeDescriptorSet, 0, NULL);
+	for (uint32_t i = 0; i < slots; i++)
+	{
+		VkDescriptorBufferInfo descriptorBufferInfo = {};
+		descriptorBufferInfo.buffer = r.buffers.at(i);
+		descriptorBufferInfo.offset = 0;
+		descriptorBufferInfo.range = r.buffer_size;
+		VkWriteDescriptorSet writeDescriptorSet = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+		writeDescriptorSet.dstSet = r.descriptorSets.at(i);
+		writeDescriptorSet.dstBinding = 0;
+		writeDescriptorSet.descriptorCount = 1;
+		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writeDescriptorSet.pBufferInfo = &descriptorBufferInfo;
+		vkUpdateDescriptorSets(vulkan.device, 1, &writeDescriptorSet, 0, NULL);
+	}
 
 	VkDeviceMemory indirectMemory = VK_NULL_HANDLE;
 	VkBuffer indirectBuffer = VK_NULL_HANDLE;
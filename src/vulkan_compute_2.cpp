@@ -416,8 +416,7 @@ int main(int argc, char** argv)
 
 	if (output)
 	{
-		test_save_image(vulkan, "mandelbrot.png", r.memory, 0, width, height);
-		bench_stop_scene(vulkan.bench, "mandelbrot.png");
+		bench_stop_scene(vulkan.bench, test_save_image(vulkan, "mandelbrot.png", r.memory, 0, width, height));
 	}
 	else bench_stop_scene(vulkan.bench);
 
@@ -90,20 +90,18 @@ static void bda_sc_create_pipeline(vulkan_setup_t& vulkan, compute_resources& r,
 
 	if (reqs.options.count("pipelinecache"))
 	{
-		char* blob = nullptr;
+		mapped_blob blob;
 		VkPipelineCacheCreateInfo cacheinfo = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO, nullptr };
 		cacheinfo.flags = 0;
 		if (reqs.options.count("cachefile") && exists_blob(std::get<std::string>(reqs.options.at("cachefile"))))
 		{
 			ILOG("Reading pipeline cache data from %s", std::get<std::string>(reqs.options.at("cachefile")).c_str());
-			uint32_t size = 0;
-			blob = load_blob(std::get<std::string>(reqs.options.at("cachefile")), &size);
-			cacheinfo.initialDataSize = size;
-			cacheinfo.pInitialData = blob;
+			blob.open(std::get<std::string>(reqs.options.at("cachefile")), mapped_blob::SEQUENTIAL);
+			cacheinfo.initialDataSize = blob.size();
+			cacheinfo.pInitialData = blob.data();
 		}
 		result = vkCreatePipelineCache(vulkan.device, &cacheinfo, nullptr, &r.cache);
 		check(result);
-		free(blob);
 	}
 
 	result = vkCreateComputePipelines(vulkan.device, r.cache, 1, &pipelineCreateInfo, nullptr, &r.pipeline);
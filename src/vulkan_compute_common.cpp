@@ -14,6 +14,7 @@ void compute_usage()
 	printf("-pc/--pipelinecache    Add a pipeline cache to compute pipeline. By default it is empty.\n");
 	printf("-pcf/--cachefile N     Save and restore pipeline cache to/from file N\n");
 	printf("-fb/--frame-boundary   Use frameboundary extension to publicize output\n");
+	printf("-fif/--frames-in-flight N Keep up to N frames in flight, cannot be combined with -fb (default 1)\n");
 	printf("-t/--times N           Times to repeat (default %d)\n", (int)p__loops);
 }
 
@@ -58,6 +59,11 @@ bool compute_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
 	{
 		return enable_frame_boundary(reqs);
 	}
+	else if (match(argv[i], "-fif", "--frames-in-flight"))
+	{
+		reqs.options["frames_in_flight"] = get_arg(argv, ++i, argc);
+		return std::get<int>(reqs.options.at("frames_in_flight")) >= 1;
+	}
 	return false;
 }
 
@@ -67,11 +73,19 @@ compute_resources compute_init(vulkan_setup_t& vulkan, vulkan_req_t& reqs)
 	VkResult result;
 
 	vkGetDeviceQueue(vulkan.device, 0, 0, &r.queue);
+	if (vulkan.bench.enable_file) bench_reserve(vulkan.bench, p__loops); // may have been changed on the command line
 
 	// set defaults if not overridden
 	if (!reqs.options.count("width")) reqs.options["width"] = 640;
 	if (!reqs.options.count("height")) reqs.options["height"] = 480;
 	if (!reqs.options.count("wg_size")) reqs.options["wg_size"] = 32;
+	if (!reqs.options.count("frames_in_flight")) reqs.options["frames_in_flight"] = 1;
+	if (reqs.options.count("frame_boundary") && std::get<int>(reqs.options.at("frames_in_flight")) > 1)
+	{
+		WLOG("Frame boundaries only supported with one frame in flight");
+		reqs.options["frames_in_flight"] = 1;
+	}
+	const int frames_in_flight = std::get<int>(reqs.options.at("frames_in_flight"));
 
 	const uint32_t width = std::get<int>(reqs.options.at("width"));
 	const uint32_t height = std::get<int>(reqs.options.at("height"));
@@ -89,8 +103,13 @@ compute_resources compute_init(vulkan_setup_t& vulkan, vulkan_req_t& reqs)
 	{
 		bufferCreateInfo.usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR;
 	}
-	result = vkCreateBuffer(vulkan.device, &bufferCreateInfo, nullptr, &r.buffer);
-	assert(result == VK_SUCCESS);
+	r.buffers.resize(frames_in_flight);
+	for (VkBuffer& buffer : r.buffers)
+	{
+		result = vkCreateBuffer(vulkan.device, &bufferCreateInfo, nullptr, &buffer);
+		assert(result == VK_SUCCESS);
+	}
+	r.buffer = r.buffers.at(0);
 
 	VkCommandPoolCreateInfo commandPoolCreateInfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr };
 	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
@@ -101,12 +120,25 @@ compute_resources compute_init(vulkan_setup_t& vulkan, vulkan_req_t& reqs)
 	VkCommandBufferAllocateInfo commandBufferAllocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr };
 	commandBufferAllocateInfo.commandPool = r.commandPool;
 	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	commandBufferAllocateInfo.commandBufferCount = 1;
-	result = vkAllocateCommandBuffers(vulkan.device, &commandBufferAllocateInfo, &r.commandBuffer);
+	commandBufferAllocateInfo.commandBufferCount = frames_in_flight;
+	r.commandBuffers.resize(frames_in_flight);
+	result = vkAllocateCommandBuffers(vulkan.device, &commandBufferAllocateInfo, r.commandBuffers.data());
 	check(result);
+	r.commandBuffer = r.commandBuffers.at(0);
+	commandBufferAllocateInfo.commandBufferCount = 1;
 	result = vkAllocateCommandBuffers(vulkan.device, &commandBufferAllocateInfo, &r.commandBufferFrameBoundary);
 	check(result);
 
+	VkFenceCreateInfo fenceCreateInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
+	fenceCreateInfo.flags = 0;
+	r.fences.resize(frames_in_flight);
+	for (VkFence& fence : r.fences)
+	{
+		result = vkCreateFence(vulkan.device, &fenceCreateInfo, nullptr, &fence);
+		check(result);
+	}
+	r.pending.resize(frames_in_flight, -1);
+
 	// Create an image for the frame boundary, in case we need it
 	const uint32_t queueFamilyIndex = 0;
 	VkImageCreateInfo imageCreateInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, nullptr };
@@ -141,7 +173,8 @@ compute_resources compute_init(vulkan_setup_t& vulkan, vulkan_req_t& reqs)
 	assert(memoryTypeIndex == memoryTypeIndex2); // else we're in trouble here
 	align_mod = memory_requirements.size % memory_requirements.alignment;
 	const uint32_t aligned_buffer_size = (align_mod == 0) ? memory_requirements.size : (memory_requirements.size + memory_requirements.alignment - align_mod);
-	total_size += aligned_buffer_size;
+	total_size += aligned_buffer_size * frames_in_flight;
+	r.buffer_stride = aligned_buffer_size;
 
 	VkMemoryAllocateInfo pAllocateMemInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
 	pAllocateMemInfo.memoryTypeIndex = memoryTypeIndex;
@@ -159,30 +192,37 @@ compute_resources compute_init(vulkan_setup_t& vulkan, vulkan_req_t& reqs)
 	check(result);
 	assert(r.memory != VK_NULL_HANDLE);
 
+	const VkDeviceSize image_offset = aligned_buffer_size * frames_in_flight; // image comes after the buffers
 	if (vulkan.apiVersion >= VK_API_VERSION_1_1)
 	{
-		VkBindBufferMemoryInfo bindBufferInfo = { VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO, nullptr };
-		bindBufferInfo.buffer = r.buffer;
-		bindBufferInfo.memory = r.memory;
-		bindBufferInfo.memoryOffset = 0;
+		std::vector<VkBindBufferMemoryInfo> bindBufferInfos(frames_in_flight, { VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO, nullptr });
+		for (int i = 0; i < frames_in_flight; i++)
+		{
+			bindBufferInfos[i].buffer = r.buffers[i];
+			bindBufferInfos[i].memory = r.memory;
+			bindBufferInfos[i].memoryOffset = i * r.buffer_stride;
+		}
 
-		result = vkBindBufferMemory2(vulkan.device, 1, &bindBufferInfo);
+		result = vkBindBufferMemory2(vulkan.device, bindBufferInfos.size(), bindBufferInfos.data());
 		check(result);
 
 		VkBindImageMemoryInfo bindImageInfo = { VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_INFO, nullptr };
 		bindImageInfo.image = r.image;
 		bindImageInfo.memory = r.memory;
-		bindImageInfo.memoryOffset = aligned_buffer_size; // comes after the buffer
+		bindImageInfo.memoryOffset = image_offset;
 
 		result = vkBindImageMemory2(vulkan.device, 1, &bindImageInfo);
 		check(result);
 	}
 	else
 	{
-		result = vkBindBufferMemory(vulkan.device, r.buffer, r.memory, 0);
-		check(result);
+		for (int i = 0; i < frames_in_flight; i++)
+		{
+			result = vkBindBufferMemory(vulkan.device, r.buffers[i], r.memory, i * r.buffer_stride);
+			check(result);
+		}
 
-		result = vkBindImageMemory(vulkan.device, r.image, r.memory, aligned_buffer_size);
+		result = vkBindImageMemory(vulkan.device, r.image, r.memory, image_offset);
 		check(result);
 	}
 
@@ -215,17 +255,30 @@ compute_resources compute_init(vulkan_setup_t& vulkan, vulkan_req_t& reqs)
 	return r;
 }
 
+// Wait for the frame in the given slot to finish and make its fence ready for reuse
+static int compute_retire(vulkan_setup_t& vulkan, compute_resources& r, int slot)
+{
+	VkResult result = vkWaitForFences(vulkan.device, 1, &r.fences.at(slot), VK_TRUE, UINT64_MAX);
+	check(result);
+	result = vkResetFences(vulkan.device, 1, &r.fences.at(slot));
+	check(result);
+	const int frame = r.pending.at(slot);
+	r.pending.at(slot) = -1;
+	return frame;
+}
+
+static std::string compute_save_output(vulkan_setup_t& vulkan, compute_resources& r, vulkan_req_t& reqs, int slot, int frame)
+{
+	std::string filename = "compute_" + std::to_string(frame) + ".png";
+	return test_save_image(vulkan, filename.c_str(), r.memory, slot * r.buffer_stride, std::get<int>(reqs.options.at("width")), std::get<int>(reqs.options.at("height")));
+}
+
 void compute_submit(vulkan_setup_t& vulkan, compute_resources& r, vulkan_req_t& reqs)
 {
 	bench_start_scene(vulkan.bench, "compute");
 	bench_start_iteration(vulkan.bench);
 
-	VkFence fence;
-	VkFenceCreateInfo fenceCreateInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
-	fenceCreateInfo.flags = 0;
-	VkResult result = vkCreateFence(vulkan.device, &fenceCreateInfo, NULL, &fence);
-	check(result);
-
+	VkResult result;
 	VkFrameBoundaryEXT fbinfo = { VK_STRUCTURE_TYPE_FRAME_BOUNDARY_EXT, nullptr };
 	fbinfo.flags = VK_FRAME_BOUNDARY_FRAME_END_BIT_EXT;
 	fbinfo.frameID = r.frame++;
@@ -264,28 +317,44 @@ void compute_submit(vulkan_setup_t& vulkan, compute_resources& r, vulkan_req_t&
 		submitInfo.pNext = &fbinfo;
 	}
 	submitInfo.pCommandBuffers = cmdbufs.data();
-	result = vkQueueSubmit(r.queue, 1, &submitInfo, fence);
+	result = vkQueueSubmit(r.queue, 1, &submitInfo, r.fences.at(r.slot));
 	check(result);
+	r.pending.at(r.slot) = r.frame;
 
-	result = vkWaitForFences(vulkan.device, 1, &fence, VK_TRUE, UINT64_MAX);
-	check(result);
-
-	vkDestroyFence(vulkan.device, fence, nullptr);
+	// Only rotate between slots if the test gave us a descriptor set for each output buffer
+	const int slots = (r.descriptorSets.size() == r.fences.size()) ? r.fences.size() : 1;
+	if (slots < (int)r.fences.size() && r.frame == 1) WLOG("This test does not support multiple frames in flight, waiting for each frame");
+	const int next = (r.slot + 1) % slots;
+	int done_frame = -1; // frame that finished during this call, if any
+	if (r.pending.at(next) != -1) done_frame = compute_retire(vulkan, r, next);
 
 	bench_stop_iteration(vulkan.bench);
-	if (reqs.options.count("image_output"))
+	if (reqs.options.count("image_output") && done_frame != -1)
 	{
-		std::string filename = "compute_" + std::to_string(r.frame) + ".png";
-		test_save_image(vulkan, filename.c_str(), r.memory, 0, std::get<int>(reqs.options.at("width")), std::get<int>(reqs.options.at("height")));
+		const std::string filename = compute_save_output(vulkan, r, reqs, next, done_frame);
 		bench_stop_scene(vulkan.bench, filename.c_str());
 	}
 	else bench_stop_scene(vulkan.bench);
 
+	// Move on to the slot we just freed up
+	r.slot = next;
+	r.commandBuffer = r.commandBuffers.at(next);
+	r.buffer = r.buffers.at(next);
+	if (slots > 1) r.descriptorSet = r.descriptorSets.at(next);
 	vkResetCommandBuffer(r.commandBuffer, 0);
 }
 
 void compute_done(vulkan_setup_t& vulkan, compute_resources& r, vulkan_req_t& reqs)
 {
+	// Finish any frames still in flight
+	for (unsigned i = 1; i <= r.pending.size(); i++)
+	{
+		const int slot = (r.slot + i) % r.pending.size(); // oldest first
+		if (r.pending.at(slot) == -1) continue;
+		const int frame = compute_retire(vulkan, r, slot);
+		if (reqs.options.count("image_output")) compute_save_output(vulkan, r, reqs, slot, frame);
+	}
+	for (VkFence fence : r.fences) vkDestroyFence(vulkan.device, fence, nullptr);
 	if (reqs.options.count("pipelinecache") && reqs.options.count("cachefile"))
 	{
 		std::string file = std::get<std::string>(reqs.options.at("cachefile"));
@@ -300,7 +369,7 @@ void compute_done(vulkan_setup_t& vulkan, compute_resources& r, vulkan_req_t& re
 		vkDestroyPipelineCache(vulkan.device, r.cache, nullptr);
 	}
 	if (r.image) vkDestroyImage(vulkan.device, r.image, NULL);
-	vkDestroyBuffer(vulkan.device, r.buffer, NULL);
+	for (VkBuffer buffer : r.buffers) vkDestroyBuffer(vulkan.device, buffer, NULL);
 	testFreeMemory(vulkan, r.memory);
 	vkDestroyShaderModule(vulkan.device, r.computeShaderModule, NULL);
 	vkDestroyDescriptorPool(vulkan.device, r.descriptorPool, NULL);
@@ -368,20 +437,18 @@ void compute_create_pipeline(vulkan_setup_t& vulkan, compute_resources& r, vulka
 
 	if (reqs.options.count("pipelinecache"))
 	{
-		char* blob = nullptr;
+		mapped_blob blob;
 		VkPipelineCacheCreateInfo cacheinfo = { VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO, nullptr };
 		cacheinfo.flags = 0;
 		if (reqs.options.count("cachefile") && exists_blob(std::get<std::string>(reqs.options.at("cachefile"))))
 		{
 			ILOG("Reading pipeline cache data from %s", std::get<std::string>(reqs.options.at("cachefile")).c_str());
-			uint32_t size = 0;
-			blob = load_blob(std::get<std::string>(reqs.options.at("cachefile")), &size);
-			cacheinfo.initialDataSize = size;
-			cacheinfo.pInitialData = blob;
+			blob.open(std::get<std::string>(reqs.options.at("cachefile")), mapped_blob::SEQUENTIAL);
+			cacheinfo.initialDataSize = blob.size();
+			cacheinfo.pInitialData = blob.data();
 		}
 		result = vkCreatePipelineCache(vulkan.device, &cacheinfo, nullptr, &r.cache);
 		check(result);
-		free(blob);
 	}
 
 	result = vkCreateComputePipelines(vulkan.device, r.cache, 1, &pipelineCreateInfo, nullptr, &r.pipeline);
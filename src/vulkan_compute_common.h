@@ -23,6 +23,18 @@ struct compute_resources
 	VkImage image = VK_NULL_HANDLE;
 	VkCommandBuffer commandBufferFrameBoundary = VK_NULL_HANDLE;
 	int frame = 0;
+
+	// used for keeping several frames in flight; commandBuffer, buffer and descriptorSet above always
+	// refer to the current slot, and are rotated by compute_submit()
+	int slot = 0;
+	std::vector<VkCommandBuffer> commandBuffers; // one per slot
+	std::vector<VkFence> fences; // one per slot, reset and reused
+	std::vector<VkBuffer> buffers; // output buffer for each slot
+	std::vector<int> pending; // frame number in flight in each slot, or -1
+	VkDeviceSize buffer_stride = 0; // distance between the output buffers in memory
+	/// Tests that support frames in flight fill this with one descriptor set per slot, pointing
+	/// to the matching output buffer. Otherwise we wait for each frame before the next.
+	std::vector<VkDescriptorSet> descriptorSets;
 };
 
 bool compute_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs);
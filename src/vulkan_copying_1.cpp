@@ -277,6 +277,21 @@ static void copying_1(int argc, char** argv)
 		}
 	}
 
+	// Host side verification of the target memory, which we never map otherwise
+	if (p__sanity)
+	{
+		std::vector<unsigned char> expected(buffer_size);
+		for (unsigned i = 0; i < num_buffers; i++)
+		{
+			const VkDeviceSize offset = dedicated_allocation ? 0 : i * target_aligned_size;
+			VkDeviceMemory memory = target_memory.at(dedicated_allocation ? i : 0);
+			memset(expected.data(), i, buffer_size);
+			const uint32_t dest = testChecksumMemory(vulkan, memory, offset, buffer_size);
+			assert(dest == adler32(expected.data(), buffer_size));
+			(void)dest;
+		}
+	}
+
 	bench_stop_iteration(vulkan.bench);
 
 	// Cleanup...
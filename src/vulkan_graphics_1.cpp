@@ -22,17 +22,44 @@
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <climits>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <external/stb_image.h>
 
+static int soak_frames = 0;
+static int soak_seconds = 0;
+static int frames_in_flight = 0; // zero means one, or two in soak mode
+
 static void show_usage()
 {
 	usage();
+	printf("-S/--soak N            Soak mode: render N frames and report frame time distribution and memory growth\n");
+	printf("-sd/--soak-duration S  Soak mode: render for S seconds\n");
+	printf("-fif/--frames-in-flight N Number of frames in flight (default 1, or 2 in soak mode)\n");
 }
 
 static bool test_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
 {
+	if (match(argv[i], "-S", "--soak"))
+	{
+		soak_frames = get_arg(argv, ++i, argc);
+		if (!reqs.options.count("frame_boundary")) enable_frame_boundary(reqs);
+		return soak_frames > 0;
+	}
+	else if (match(argv[i], "-sd", "--soak-duration"))
+	{
+		soak_seconds = get_arg(argv, ++i, argc);
+		if (!reqs.options.count("frame_boundary")) enable_frame_boundary(reqs);
+		return soak_seconds > 0;
+	}
+	else if (match(argv[i], "-fif", "--frames-in-flight"))
+	{
+		frames_in_flight = get_arg(argv, ++i, argc);
+		return frames_in_flight > 0;
+	}
 	return parseCmdopt(i, argc, argv, reqs);
 }
 
@@ -68,6 +95,15 @@ typedef struct Transform {
 	alignas(16) glm::mat4 proj;
 } Transform;
 
+// resources that each frame in flight needs its own copy of
+struct FrameData
+{
+	std::shared_ptr<CommandBuffer> m_commandBuffer;
+	std::unique_ptr<Buffer> m_transformUniformBuffer;
+	std::unique_ptr<DescriptorSet> m_descriptor;
+	VkFence m_fence = VK_NULL_HANDLE;
+};
+
 class benchmarkContext : public GraphicContext
 {
 public:
@@ -80,36 +116,34 @@ public:
 		DLOG3("MEM detection: graphic_1 benchmark destroy().");
 		m_vertexBuffer = nullptr;
 		m_indexBuffer = nullptr;
-		m_transformUniformBuffer = nullptr;
 		m_bgSampler = nullptr;
 		m_bgImageView = nullptr;
-		m_descriptor = nullptr;
 		m_pipeline = nullptr;
 
-		if (m_frameFence != VK_NULL_HANDLE)
+		for (FrameData& frame : m_frames)
 		{
-			vkDestroyFence(m_vulkanSetup.device, m_frameFence, nullptr);
-			m_frameFence = VK_NULL_HANDLE;
+			frame.m_commandBuffer = nullptr;
+			frame.m_transformUniformBuffer = nullptr;
+			frame.m_descriptor = nullptr;
+			if (frame.m_fence != VK_NULL_HANDLE) vkDestroyFence(m_vulkanSetup.device, frame.m_fence, nullptr);
 		}
+		m_frames.clear();
 	}
 
 	// contexts and resources related with benchmark
 	std::unique_ptr<Buffer> m_vertexBuffer;
 	std::unique_ptr<Buffer> m_indexBuffer;
-	std::unique_ptr<Buffer> m_transformUniformBuffer;
 
 	std::unique_ptr<Sampler> m_bgSampler;
 	std::unique_ptr<ImageView> m_bgImageView;
 
 	std::unique_ptr<GraphicPipeline> m_pipeline;
-	std::unique_ptr<DescriptorSet> m_descriptor;
-
-	VkFence m_frameFence = VK_NULL_HANDLE;
 
+	std::vector<FrameData> m_frames;
 };
 
 static std::unique_ptr<benchmarkContext> p_benchmark = nullptr;
-static void render(const vulkan_setup_t& vulkan);
+static void render(const vulkan_setup_t& vulkan, bool frame_boundary);
 
 int main(int argc, char** argv)
 {
@@ -121,6 +155,9 @@ int main(int argc, char** argv)
 	vulkan_setup_t vulkan = test_init(argc, argv, "vulkan_graphics_1", req);
 
 	p_benchmark->initBasic(vulkan, req);
+	const bool soak = soak_frames > 0 || soak_seconds > 0;
+	if (frames_in_flight == 0) frames_in_flight = soak ? 2 : 1;
+	p_benchmark->m_frames.resize(frames_in_flight);
 
 	// ------------------------ vulkan resources created -----------------------------
 
@@ -147,10 +184,13 @@ int main(int argc, char** argv)
 
 	p_benchmark->updateBuffer(indices, *indexBuffer);
 
-	// ubo
-	auto transformUniformBuffer = std::make_unique<Buffer>(vulkan);
-	transformUniformBuffer->create(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, (VkDeviceSize)sizeof(Transform), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	transformUniformBuffer->map();
+	// ubo, one for each frame in flight
+	for (FrameData& frame : p_benchmark->m_frames)
+	{
+		frame.m_transformUniformBuffer = std::make_unique<Buffer>(vulkan);
+		frame.m_transformUniformBuffer->create(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, (VkDeviceSize)sizeof(Transform), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		frame.m_transformUniformBuffer->map();
+	}
 
 	/******************** sampled texture image for background **********************/
 	// loading image
@@ -194,15 +234,19 @@ int main(int argc, char** argv)
 	// descriptorPool
 #define MAX_DESCRIPTOR_SET_SIZE 4
 	auto mainDescSetPool = std::make_shared<DescriptorSetPool>(mainDescSetLayout);
-	mainDescSetPool->create(MAX_DESCRIPTOR_SET_SIZE);
+	mainDescSetPool->create(std::max(MAX_DESCRIPTOR_SET_SIZE, frames_in_flight));
 
-	// descritorSet
-	auto descriptor = std::make_unique<DescriptorSet>(std::move(mainDescSetPool));
-	descriptor->create();
-	//configure descriptor set, and then update
-	descriptor->setBuffer(0, *transformUniformBuffer);  //layout(set=0,binding=0) uniform transformBuffer { }
-	descriptor->setCombinedImageSampler(1, *bgImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, *bgSampler);  //layout(set=0, binding=1) uniform sampler2D
-	descriptor->update();
+	// descritorSet, one for each frame in flight
+	for (FrameData& frame : p_benchmark->m_frames)
+	{
+		frame.m_descriptor = std::make_unique<DescriptorSet>(mainDescSetPool);
+		frame.m_descriptor->create();
+		//configure descriptor set, and then update
+		frame.m_descriptor->setBuffer(0, *frame.m_transformUniformBuffer);  //layout(set=0,binding=0) uniform transformBuffer { }
+		frame.m_descriptor->setCombinedImageSampler(1, *bgImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, *bgSampler);  //layout(set=0, binding=1) uniform sampler2D
+		frame.m_descriptor->update();
+	}
+	mainDescSetPool = nullptr;
 
 
 	// ------------------------- graphic pipeline setup ------------------------------
@@ -284,11 +328,9 @@ int main(int argc, char** argv)
 	/****************************** save all resources ******************************/
 	p_benchmark->m_vertexBuffer = std::move(vertexBuffer);
 	p_benchmark->m_indexBuffer = std::move(indexBuffer);
-	p_benchmark->m_transformUniformBuffer = std::move(transformUniformBuffer);
 
 	p_benchmark->m_bgSampler = std::move(bgSampler);
 	p_benchmark->m_bgImageView = std::move(bgImageView);
-	p_benchmark->m_descriptor = std::move(descriptor);
 
 	p_benchmark->m_pipeline = std::move(pipeline);
 
@@ -298,10 +340,23 @@ int main(int argc, char** argv)
 	VkFenceCreateInfo fenceInfo{};
 	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-	vkCreateFence(vulkan.device, &fenceInfo, nullptr, &p_benchmark->m_frameFence);
+	for (unsigned i = 0; i < p_benchmark->m_frames.size(); i++)
+	{
+		FrameData& frame = p_benchmark->m_frames[i];
+		vkCreateFence(vulkan.device, &fenceInfo, nullptr, &frame.m_fence);
+		if (i == 0)
+		{
+			frame.m_commandBuffer = p_benchmark->m_defaultCommandBuffer;
+		}
+		else
+		{
+			frame.m_commandBuffer = std::make_shared<CommandBuffer>(p_benchmark->m_defaultCommandPool);
+			frame.m_commandBuffer->create(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+		}
+	}
 
 	/********************************** rendering ***********************************/
-	render(vulkan);
+	render(vulkan, req.options.count("frame_boundary") > 0);
 
 	vkDeviceWaitIdle(vulkan.device);
 
@@ -340,68 +395,131 @@ void updateTransformData(Buffer& dstBuffer)
 	dstBuffer.flush(true);
 }
 
-static void render(const vulkan_setup_t& vulkan)
+static void record(FrameData& frame)
+{
+	VkCommandBuffer defaultCmd = frame.m_commandBuffer->getHandle();
+	vkResetCommandBuffer(defaultCmd, 0);
+
+	frame.m_commandBuffer->begin();
+	frame.m_commandBuffer->beginRenderPass(*p_benchmark->m_renderPass, *p_benchmark->m_framebuffer);
+
+	vkCmdBindPipeline(defaultCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p_benchmark->m_pipeline->getHandle());
+	//one alternative: frame.m_commandBuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, *p_benchmark->m_pipeline);
+
+	// bind vertex buffer to bindings
+	VkBuffer vertexBuffers[] = {p_benchmark->m_vertexBuffer->getHandle()};
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(defaultCmd, 0, 1, vertexBuffers, offsets);
+	// bind index buffer
+	vkCmdBindIndexBuffer(defaultCmd, p_benchmark->m_indexBuffer->getHandle(), 0, VK_INDEX_TYPE_UINT16);
+
+	VkDescriptorSet descriptor = frame.m_descriptor->getHandle();
+	vkCmdBindDescriptorSets(defaultCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p_benchmark->m_pipeline->m_pipelineLayout->getHandle(), 0, 1, &descriptor, 0, nullptr);
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(p_benchmark->width);
+	viewport.height = static_cast<float>(p_benchmark->height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(defaultCmd, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = {0, 0};
+	scissor.extent = {p_benchmark->width, p_benchmark->height};
+	vkCmdSetScissor(defaultCmd, 0, 1, &scissor);
+	vkCmdDrawIndexed(defaultCmd, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+
+	frame.m_commandBuffer->endRenderPass();
+	frame.m_commandBuffer->end();
+}
+
+/// Print frame time percentiles, jitter and memory growth gathered in soak mode
+static void soak_report(int frames, std::vector<uint64_t>& frame_times, const std::vector<std::pair<int, long>>& rss_samples, uint64_t total_time)
 {
-	bool first_loop = true;
-	benchmarking bench = vulkan.bench;
+	if (frame_times.empty()) return;
+	double sum = 0.0;
+	double jitter = 0.0;
+	for (unsigned i = 0; i < frame_times.size(); i++)
+	{
+		sum += frame_times[i];
+		if (i > 0) jitter += std::abs((double)frame_times[i] - (double)frame_times[i - 1]);
+	}
+	const double mean = sum / frame_times.size();
+	double variance = 0.0;
+	for (uint64_t t : frame_times) variance += (t - mean) * (t - mean);
+	variance /= frame_times.size();
+	if (frame_times.size() > 1) jitter /= frame_times.size() - 1;
+
+	std::sort(frame_times.begin(), frame_times.end());
+	auto percentile = [&](double p) { return frame_times[std::min(frame_times.size() - 1, (size_t)(p / 100.0 * frame_times.size()))] / 1000000.0; };
+	printf("Soak: %d frames in %.1f s with %d frames in flight, %.1f fps\n", frames, total_time / 1000000000.0, frames_in_flight,
+	       frames * 1000000000.0 / total_time);
+	printf("Frame time: mean %.3f ms, min %.3f ms, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n", mean / 1000000.0,
+	       frame_times.front() / 1000000.0, percentile(50.0), percentile(90.0), percentile(99.0), percentile(99.9), frame_times.back() / 1000000.0);
+	printf("Jitter: %.3f ms mean frame-to-frame change, %.3f ms standard deviation\n", jitter / 1000000.0, std::sqrt(variance) / 1000000.0);
+
+	// print at most ten evenly spaced samples of the memory curve
+	const unsigned step = std::max<unsigned>(1, rss_samples.size() / 10);
+	for (unsigned i = 0; i < rss_samples.size(); i += step) printf("\tframe %d: RSS %ld kB\n", rss_samples[i].first, rss_samples[i].second);
+	if (rss_samples.size() > 1)
+	{
+		const long growth = rss_samples.back().second - rss_samples.front().second;
+		const int sampled = rss_samples.back().first - rss_samples.front().first;
+		printf("Memory growth: %ld kB over %d frames (%.1f bytes per frame)\n", growth, sampled, growth * 1024.0 / std::max(sampled, 1));
+	}
+}
 
-	while (p__loops--)
+static void render(const vulkan_setup_t& vulkan, bool frame_boundary)
+{
+	benchmarking& bench = p_benchmark->m_vulkanSetup.bench; // the copy that test_done() writes out
+	const bool soak = soak_frames > 0 || soak_seconds > 0;
+	const int total = soak_frames ? soak_frames : (soak ? INT_MAX : (int)p__loops);
+	if (total != INT_MAX) bench_reserve(bench, total); // with -sd the raw samples wrap around, the histogram still sees every frame
+	const uint64_t deadline = soak_seconds * 1000000000ull;
+	const int rss_interval = 1000; // frames between memory samples in soak mode
+	std::vector<uint64_t> frame_times;
+	std::vector<std::pair<int, long>> rss_samples;
+	if (soak) frame_times.reserve(std::min(total, 1000000));
+
+	const uint64_t begin = gettime();
+	uint64_t last = begin;
+	bool in_iteration = false;
+	int frame = 0;
+	for (; frame < total; frame++)
 	{
-		VkCommandBuffer defaultCmd = p_benchmark->m_defaultCommandBuffer->getHandle();
+		FrameData& data = p_benchmark->m_frames[frame % p_benchmark->m_frames.size()];
 
-		vkWaitForFences(vulkan.device, 1, &p_benchmark->m_frameFence, VK_TRUE, UINT64_MAX);
+		vkWaitForFences(vulkan.device, 1, &data.m_fence, VK_TRUE, UINT64_MAX);
 
-		if (!first_loop)
+		const uint64_t now = gettime();
+		if (in_iteration)
 		{
 			bench_stop_iteration(bench);
+			in_iteration = false;
+			if (soak) frame_times.push_back(now - last);
 		}
-		updateTransformData(*p_benchmark->m_transformUniformBuffer);
-
-		vkResetFences(vulkan.device, 1, &p_benchmark->m_frameFence);
-		vkResetCommandBuffer(defaultCmd, 0);
-
-		p_benchmark->m_defaultCommandBuffer->begin();
-		p_benchmark->m_defaultCommandBuffer->beginRenderPass(*p_benchmark->m_renderPass, *p_benchmark->m_framebuffer);
-
-		vkCmdBindPipeline(defaultCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p_benchmark->m_pipeline->getHandle());
-		//one alternative: p_benchmark->m_defaultCommandBuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, *p_benchmark->m_pipeline);
-
-		// bind vertex buffer to bindings
-		VkBuffer vertexBuffers[] = {p_benchmark->m_vertexBuffer->getHandle()};
-		VkDeviceSize offsets[] = {0};
-		vkCmdBindVertexBuffers(defaultCmd, 0, 1, vertexBuffers, offsets);
-		// bind index buffer
-		vkCmdBindIndexBuffer(defaultCmd, p_benchmark->m_indexBuffer->getHandle(), 0, VK_INDEX_TYPE_UINT16);
-
-		VkDescriptorSet descriptor = p_benchmark->m_descriptor->getHandle();
-		vkCmdBindDescriptorSets(defaultCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p_benchmark->m_pipeline->m_pipelineLayout->getHandle(), 0, 1, &descriptor, 0, nullptr);
-
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = static_cast<float>(p_benchmark->width);
-		viewport.height = static_cast<float>(p_benchmark->height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-		vkCmdSetViewport(defaultCmd, 0, 1, &viewport);
-
-		VkRect2D scissor{};
-		scissor.offset = {0, 0};
-		scissor.extent = {p_benchmark->width, p_benchmark->height};
-		vkCmdSetScissor(defaultCmd, 0, 1, &scissor);
-		vkCmdDrawIndexed(defaultCmd, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-
-		p_benchmark->m_defaultCommandBuffer->endRenderPass();
-		p_benchmark->m_defaultCommandBuffer->end();
+		last = now;
+		if (soak && frame % rss_interval == 0) rss_samples.push_back({ frame, get_rss() });
+		if (soak_seconds && now - begin >= deadline) break;
 
 		bench_start_iteration(bench);
+		in_iteration = true;
+		updateTransformData(*data.m_transformUniformBuffer);
 
-		// submit
-		p_benchmark->submit(p_benchmark->m_defaultQueue, std::vector<std::shared_ptr<CommandBuffer>> {p_benchmark->m_defaultCommandBuffer}, p_benchmark->m_frameFence);
+		vkResetFences(vulkan.device, 1, &data.m_fence);
+		record(data);
 
-		first_loop = false;
+		// submit
+		p_benchmark->submit(p_benchmark->m_defaultQueue, std::vector<std::shared_ptr<CommandBuffer>> {data.m_commandBuffer}, data.m_fence, {}, {}, false, frame_boundary);
 	}
 
-	vkWaitForFences(vulkan.device, 1, &p_benchmark->m_frameFence, VK_TRUE, UINT64_MAX);
-	bench_stop_iteration(bench);
+	for (FrameData& data : p_benchmark->m_frames) vkWaitForFences(vulkan.device, 1, &data.m_fence, VK_TRUE, UINT64_MAX);
+	if (in_iteration) bench_stop_iteration(bench);
+	if (soak)
+	{
+		rss_samples.push_back({ frame, get_rss() });
+		soak_report(frame, frame_times, rss_samples, gettime() - begin);
+	}
 }
@@ -12,6 +12,7 @@ void usage()
 	printf("-H/--height            Height of output image (default 480)\n");
 	printf("-wg/--workgroup-size   Set workgroup size for compute dispatch (default 32)\n");
 	printf("-fb/--frame-boundary   Use frameboundary extension to publicize output\n");
+	printf("-sa/--suballocate      Suballocate buffer and image memory from large blocks\n");
 	printf("-t/--times N           Times to repeat (default %d)\n", (int)p__loops);
 }
 
@@ -41,11 +42,155 @@ bool parseCmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
 	{
 		return enable_frame_boundary(reqs);
 	}
+	else if (match(argv[i], "-sa", "--suballocate"))
+	{
+		reqs.options["suballocate"] = 1;
+		return true;
+	}
 	return false;
 }
 
 using namespace tracetooltests;
 
+static std::shared_ptr<MemoryAllocator> current_allocator;
+
+MemoryAllocator::MemoryAllocator(const vulkan_setup_t& vulkan, VkDeviceSize blockSize)
+	: m_device(vulkan.device)
+	, m_apiVersion(vulkan.apiVersion)
+{
+	vkGetPhysicalDeviceMemoryProperties(vulkan.physical, &m_memoryProperties);
+	m_maxOrder = m_minOrder;
+	while (((VkDeviceSize)1 << m_maxOrder) < blockSize) m_maxOrder++;
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+	for (auto& pool : m_pools)
+	{
+		for (auto& block : pool.blocks)
+		{
+			if (block.mapped) vkUnmapMemory(m_device, block.memory);
+			vkFreeMemory(m_device, block.memory, nullptr);
+		}
+	}
+}
+
+void MemoryAllocator::setCurrent(std::shared_ptr<MemoryAllocator> allocator)
+{
+	current_allocator = allocator;
+}
+
+std::shared_ptr<MemoryAllocator> MemoryAllocator::current()
+{
+	return current_allocator;
+}
+
+bool MemoryAllocator::allocateBlock(Pool& pool)
+{
+	VkMemoryAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr };
+	allocateInfo.allocationSize = (VkDeviceSize)1 << m_maxOrder;
+	allocateInfo.memoryTypeIndex = pool.memoryTypeIndex;
+	VkMemoryAllocateFlagsInfo flagInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO, nullptr, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT, 0 };
+	if (pool.deviceAddress && m_apiVersion >= VK_API_VERSION_1_1) allocateInfo.pNext = &flagInfo;
+
+	Block block;
+	VkResult result = vkAllocateMemory(m_device, &allocateInfo, nullptr, &block.memory);
+	if (result != VK_SUCCESS)
+	{
+		WLOG("Failed to allocate a %lu byte memory block of type %u", (unsigned long)allocateInfo.allocationSize, pool.memoryTypeIndex);
+		return false;
+	}
+	if (m_memoryProperties.memoryTypes[pool.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		result = vkMapMemory(m_device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+		check(result);
+	}
+	block.freeLists.resize(m_maxOrder - m_minOrder + 1);
+	block.freeLists.back().insert(0);
+	pool.blocks.push_back(std::move(block));
+	m_blockCount++;
+	return true;
+}
+
+bool MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool optimal, bool deviceAddress, Allocation& allocation)
+{
+	// buddies are aligned to their own size, so rounding up to the alignment covers that too
+	uint32_t order = m_minOrder;
+	while (((VkDeviceSize)1 << order) < std::max(requirements.size, requirements.alignment)) order++;
+	if (order > m_maxOrder) return false;
+
+	const uint32_t memoryTypeIndex = get_device_memory_type(requirements.memoryTypeBits, properties);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	uint32_t poolIndex = 0;
+	for (; poolIndex < m_pools.size(); poolIndex++)
+	{
+		const Pool& pool = m_pools[poolIndex];
+		if (pool.memoryTypeIndex == memoryTypeIndex && pool.optimal == optimal && pool.deviceAddress == deviceAddress) break;
+	}
+	if (poolIndex == m_pools.size())
+	{
+		Pool pool;
+		pool.memoryTypeIndex = memoryTypeIndex;
+		pool.optimal = optimal;
+		pool.deviceAddress = deviceAddress;
+		m_pools.push_back(std::move(pool));
+	}
+	Pool& pool = m_pools[poolIndex];
+
+	for (uint32_t blockIndex = 0; ; blockIndex++)
+	{
+		if (blockIndex == pool.blocks.size() && !allocateBlock(pool)) return false;
+		Block& block = pool.blocks[blockIndex];
+
+		// find the smallest free buddy that is large enough, and split it down to the wanted order
+		uint32_t found = order;
+		while (found <= m_maxOrder && block.freeLists[found - m_minOrder].empty()) found++;
+		if (found > m_maxOrder) continue;
+
+		auto& freeList = block.freeLists[found - m_minOrder];
+		const VkDeviceSize offset = *freeList.begin();
+		freeList.erase(freeList.begin());
+		while (found > order)
+		{
+			found--;
+			block.freeLists[found - m_minOrder].insert(offset + ((VkDeviceSize)1 << found));
+		}
+
+		allocation.memory = block.memory;
+		allocation.offset = offset;
+		allocation.size = (VkDeviceSize)1 << order;
+		allocation.mapped = block.mapped ? (char*)block.mapped + offset : nullptr;
+		allocation.pool = poolIndex;
+		allocation.block = blockIndex;
+		allocation.order = order;
+		m_totalAllocations++;
+		return true;
+	}
+}
+
+void MemoryAllocator::free(Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE) return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Block& block = m_pools.at(allocation.pool).blocks.at(allocation.block);
+	VkDeviceSize offset = allocation.offset;
+	uint32_t order = allocation.order;
+	// merge with the buddy for as long as it is free as well
+	while (order < m_maxOrder)
+	{
+		auto& freeList = block.freeLists[order - m_minOrder];
+		auto buddy = freeList.find(offset ^ ((VkDeviceSize)1 << order));
+		if (buddy == freeList.end()) break;
+		offset = std::min(offset, *buddy);
+		freeList.erase(buddy);
+		order++;
+	}
+	block.freeLists[order - m_minOrder].insert(offset);
+	allocation = Allocation();
+}
+
 VkResult Buffer::create(VkBufferUsageFlags usage, VkDeviceSize size, VkMemoryPropertyFlags properties, const std::vector<uint32_t>& queueFamilyIndices /* = { }*/)
 {
 	m_queueFamilyIndices = { queueFamilyIndices.begin(), queueFamilyIndices.end() };
@@ -76,7 +221,7 @@ VkResult Buffer::create(VkBufferUsageFlags usage, VkDeviceSize size, VkMemoryPro
 
 	m_allocateInfo.pNext = m_pAllocateNext;
 
-	return create();
+	return create(true);
 }
 
 VkResult Buffer::create(const BufferCreateInfoFunc& createInfoFunc, const AllocationCreateInfoFunc& allocationInfoFunc)
@@ -90,12 +235,18 @@ VkResult Buffer::map(VkDeviceSize offset/*=0*/, VkDeviceSize size/*=VK_WHOLE_SIZ
 {
 	VkResult result;
 
+	if (m_allocator)
+	{
+		assert(m_allocation.mapped);
+		m_mappedAddress = (char*)m_allocation.mapped + offset;
+		return VK_SUCCESS;
+	}
 	result = vkMapMemory(m_device, m_memory, offset, size, flag, &m_mappedAddress);
 	check(result);
 	return result;
 }
 
-void Buffer::flush(bool extra)
+void Buffer::flush(bool extra, VkDeviceSize offset/*=0*/, VkDeviceSize size/*=VK_WHOLE_SIZE*/)
 {
 	if (!emit_extra_flushes && extra) return;
 	VkFlushRangesFlagsARM frf = { VK_STRUCTURE_TYPE_FLUSH_RANGES_FLAGS_ARM, nullptr };
@@ -103,14 +254,14 @@ void Buffer::flush(bool extra)
 	VkMappedMemoryRange mmr = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr };
 	if (extra) mmr.pNext = &frf;
 	mmr.memory = m_memory;
-	mmr.offset = 0;
-	mmr.size = VK_WHOLE_SIZE;
+	mmr.offset = m_allocation.offset + offset;
+	mmr.size = (m_allocator && size == VK_WHOLE_SIZE) ? m_allocation.size - offset : size;
 	vkFlushMappedMemoryRanges(m_device, 1, &mmr);
 }
 
 void Buffer::unmap()
 {
-	if (m_mappedAddress) vkUnmapMemory(m_device, m_memory);
+	if (m_mappedAddress && !m_allocator) vkUnmapMemory(m_device, m_memory);
 	m_mappedAddress = nullptr;
 }
 
@@ -148,7 +299,9 @@ VkResult Buffer::destroy()
 
 		unmap();
 		vkDestroyBuffer(m_device, m_handle, nullptr);
-		vkFreeMemory(m_device, m_memory, nullptr);
+		if (m_allocator) m_allocator->free(m_allocation);
+		else vkFreeMemory(m_device, m_memory, nullptr);
+		m_allocator = nullptr;
 		m_handle = VK_NULL_HANDLE;
 		m_memory = VK_NULL_HANDLE;
 		m_deviceAddress = 0;
@@ -159,7 +312,7 @@ VkResult Buffer::destroy()
 	return VK_SUCCESS;
 }
 
-VkResult Buffer::create()
+VkResult Buffer::create(bool suballocate)
 {
 	VkResult result = vkCreateBuffer(m_device, &m_createInfo, nullptr, &m_handle);
 	check(result);
@@ -168,15 +321,25 @@ VkResult Buffer::create()
 	VkMemoryRequirements memRequirements = {};
 	vkGetBufferMemoryRequirements(m_device, m_handle, &memRequirements);
 
-	const uint32_t alignMod = memRequirements.size % memRequirements.alignment;
-	const uint32_t alignedSize = (alignMod == 0) ? memRequirements.size : (memRequirements.size + memRequirements.alignment - alignMod);
-	const uint32_t memoryTypeIndex = get_device_memory_type(memRequirements.memoryTypeBits, m_memoryProperty);
+	if (suballocate) m_allocator = MemoryAllocator::current();
+	if (m_allocator && m_allocator->allocate(memRequirements, m_memoryProperty, false, m_createInfo.usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, m_allocation))
+	{
+		m_memory = m_allocation.memory;
+	}
+	else
+	{
+		m_allocator = nullptr;
 
-	m_allocateInfo.memoryTypeIndex = memoryTypeIndex;
-	m_allocateInfo.allocationSize = alignedSize;
+		const uint32_t alignMod = memRequirements.size % memRequirements.alignment;
+		const uint32_t alignedSize = (alignMod == 0) ? memRequirements.size : (memRequirements.size + memRequirements.alignment - alignMod);
+		const uint32_t memoryTypeIndex = get_device_memory_type(memRequirements.memoryTypeBits, m_memoryProperty);
 
-	result = vkAllocateMemory(m_device, &m_allocateInfo, nullptr, &m_memory);
-	check(result);
+		m_allocateInfo.memoryTypeIndex = memoryTypeIndex;
+		m_allocateInfo.allocationSize = alignedSize;
+
+		result = vkAllocateMemory(m_device, &m_allocateInfo, nullptr, &m_memory);
+		check(result);
+	}
 	assert(m_memory != VK_NULL_HANDLE);
 
 	if (vulkan2.apiVersion >= VK_API_VERSION_1_1)
@@ -184,13 +347,13 @@ VkResult Buffer::create()
 		VkBindBufferMemoryInfo bindBufferInfo = { VK_STRUCTURE_TYPE_BIND_BUFFER_MEMORY_INFO, nullptr };
 		bindBufferInfo.buffer = m_handle;
 		bindBufferInfo.memory = m_memory;
-		bindBufferInfo.memoryOffset = 0;
+		bindBufferInfo.memoryOffset = m_allocation.offset;
 
 		result = vkBindBufferMemory2(m_device, 1, &bindBufferInfo);
 	}
 	else
 	{
-		result = vkBindBufferMemory(m_device, m_handle, m_memory, 0);
+		result = vkBindBufferMemory(m_device, m_handle, m_memory, m_allocation.offset);
 	}
 	check(result);
 
@@ -241,26 +404,36 @@ VkResult Image::create(VkExtent3D extent, VkFormat format, VkImageUsageFlags usa
 	VkMemoryRequirements memRequirements = {};
 	vkGetImageMemoryRequirements(m_device, m_handle, &memRequirements);
 
-	const uint32_t alignMod = memRequirements.size % memRequirements.alignment;
-	const uint32_t alignedSize = (alignMod == 0) ? memRequirements.size : (memRequirements.size + memRequirements.alignment - alignMod);
-
-	VkMemoryAllocateInfo allocateMemInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr };
-	allocateMemInfo.memoryTypeIndex = get_device_memory_type(memRequirements.memoryTypeBits, properties);
-	allocateMemInfo.allocationSize = alignedSize;
-
-	VkMemoryAllocateFlagsInfo flaginfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO, nullptr, 0, 0 };
-
-	if (req2.bufferDeviceAddress)
+	m_allocator = MemoryAllocator::current();
+	if (m_allocator && m_allocator->allocate(memRequirements, properties, tiling == VK_IMAGE_TILING_OPTIMAL, req2.bufferDeviceAddress, m_allocation))
 	{
-		flaginfo.flags |= VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+		m_memory = m_allocation.memory;
 	}
-	if (vulkan2.apiVersion >= VK_API_VERSION_1_1)
+	else
 	{
-		allocateMemInfo.pNext = &flaginfo;
-	}
+		m_allocator = nullptr;
 
-	result = vkAllocateMemory(m_device, &allocateMemInfo, nullptr, &m_memory);
-	check(result);
+		const uint32_t alignMod = memRequirements.size % memRequirements.alignment;
+		const uint32_t alignedSize = (alignMod == 0) ? memRequirements.size : (memRequirements.size + memRequirements.alignment - alignMod);
+
+		VkMemoryAllocateInfo allocateMemInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr };
+		allocateMemInfo.memoryTypeIndex = get_device_memory_type(memRequirements.memoryTypeBits, properties);
+		allocateMemInfo.allocationSize = alignedSize;
+
+		VkMemoryAllocateFlagsInfo flaginfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO, nullptr, 0, 0 };
+
+		if (req2.bufferDeviceAddress)
+		{
+			flaginfo.flags |= VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+		}
+		if (vulkan2.apiVersion >= VK_API_VERSION_1_1)
+		{
+			allocateMemInfo.pNext = &flaginfo;
+		}
+
+		result = vkAllocateMemory(m_device, &allocateMemInfo, nullptr, &m_memory);
+		check(result);
+	}
 	assert(m_memory != VK_NULL_HANDLE);
 
 	if (vulkan2.apiVersion >= VK_API_VERSION_1_1)
@@ -268,13 +441,13 @@ VkResult Image::create(VkExtent3D extent, VkFormat format, VkImageUsageFlags usa
 		VkBindImageMemoryInfo bindImageInfo = { VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_INFO, nullptr };
 		bindImageInfo.image = m_handle;
 		bindImageInfo.memory = m_memory;
-		bindImageInfo.memoryOffset = 0;
+		bindImageInfo.memoryOffset = m_allocation.offset;
 
 		result = vkBindImageMemory2(m_device, 1, &bindImageInfo);
 	}
 	else
 	{
-		result = vkBindImageMemory(m_device, m_handle, m_memory, 0);
+		result = vkBindImageMemory(m_device, m_handle, m_memory, m_allocation.offset);
 	}
 	check(result);
 
@@ -325,7 +498,9 @@ VkResult Image::destroy()
 	DLOG3("MEM detection: image destroy().");
 
 	vkDestroyImage(m_device, m_handle, nullptr);
-	vkFreeMemory(m_device, m_memory, nullptr);
+	if (m_allocator) m_allocator->free(m_allocation);
+	else vkFreeMemory(m_device, m_memory, nullptr);
+	m_allocator = nullptr;
 	m_handle = VK_NULL_HANDLE;
 	m_memory = VK_NULL_HANDLE;
 
@@ -500,12 +675,31 @@ VkResult CommandBuffer::begin(VkCommandBufferUsageFlags flags /*=0*/, const Comm
 	return result;
 }
 
+VkResult CommandBuffer::beginSecondary(const RenderPass* renderPass, const FrameBuffer* frameBuffer /*=nullptr*/, VkCommandBufferUsageFlags flags /*=0*/, uint32_t subpass /*=0*/)
+{
+	VkCommandBufferInheritanceInfo inheritInfo { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO, nullptr };
+	VkCommandBufferBeginInfo beginInfo { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr };
+	beginInfo.flags = flags;
+	beginInfo.pInheritanceInfo = &inheritInfo;
+	if (renderPass)
+	{
+		inheritInfo.renderPass = renderPass->getHandle();
+		inheritInfo.subpass = subpass;
+		inheritInfo.framebuffer = frameBuffer ? frameBuffer->getHandle() : VK_NULL_HANDLE;
+		beginInfo.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	}
+
+	VkResult result = vkBeginCommandBuffer(m_handle, &beginInfo);
+	check(result);
+	return result;
+}
+
 VkResult CommandBuffer::end()
 {
 	return vkEndCommandBuffer(m_handle);
 }
 
-void CommandBuffer::beginRenderPass(const RenderPass& renderPass, const FrameBuffer& frameBuffer)
+void CommandBuffer::beginRenderPass(const RenderPass& renderPass, const FrameBuffer& frameBuffer, VkSubpassContents contents /*=VK_SUBPASS_CONTENTS_INLINE*/)
 {
 	VkRenderPassBeginInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -524,7 +718,7 @@ void CommandBuffer::beginRenderPass(const RenderPass& renderPass, const FrameBuf
 	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());;
 	renderPassInfo.pClearValues = clearValues.data();
 
-	vkCmdBeginRenderPass(m_handle, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBeginRenderPass(m_handle, &renderPassInfo, contents);
 
 }
 
@@ -533,6 +727,14 @@ void CommandBuffer::endRenderPass()
 	vkCmdEndRenderPass(m_handle);
 }
 
+void CommandBuffer::executeCommands(const std::vector<std::shared_ptr<CommandBuffer>>& commandBuffers)
+{
+	std::vector<VkCommandBuffer> commands;
+	for (auto& iter : commandBuffers)
+		commands.push_back(iter->getHandle());
+	vkCmdExecuteCommands(m_handle, static_cast<uint32_t>(commands.size()), commands.data());
+}
+
 void CommandBuffer::bindPipeline(VkPipelineBindPoint bindpoint, const GraphicPipeline& pipeline)
 {
 	vkCmdBindPipeline(m_handle, bindpoint, pipeline.getHandle());
@@ -609,9 +811,9 @@ void CommandBuffer::copyBufferToImage(const Buffer& srcBuffer, Image& image, VkD
 
 VkResult Shader::create(const std::string& filename)
 {
-	auto shaderCode = readFile(filename);
+	mapped_blob shaderCode(filename, mapped_blob::POPULATE); // page aligned, so fine to use as uint32_t array
 
-	m_createInfo.codeSize= shaderCode.size();
+	m_createInfo.codeSize = shaderCode.size();
 	m_createInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
 	return create();
 }
@@ -1530,67 +1732,178 @@ VkResult ComputePipeline::destroy()
 	return result;
 }
 
-void GraphicContext::updateBuffer(const char* srcData, VkDeviceSize size, const Buffer& dstBuffer, VkDeviceSize dstOffset /*=0*/, VkDeviceSize srcOffset /*=0*/, bool submitOnce /*=false*/ )
+const Buffer& GraphicContext::stageData(const char* srcData, VkDeviceSize size, VkDeviceSize& stagingOffset)
 {
-	auto staging = std::make_unique<Buffer>(m_vulkanSetup);
-	staging->create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	if (size > m_stagingRingSize)
+	{
+		auto staging = std::make_unique<Buffer>(m_vulkanSetup);
+		staging->create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+		staging->map();
+		memcpy(staging->m_mappedAddress, srcData, (size_t)size);
+		staging->flush(true);
+		staging->unmap();
+
+		StagingBatch& batch = openStagingBatch(m_stagingHead);
+		batch.m_dedicated.push_back(std::move(staging));
+		stagingOffset = 0;
+		return *batch.m_dedicated.back();
+	}
 
-	staging->map();
-	memcpy(staging->m_mappedAddress, srcData, (size_t)size);
-	staging->flush(true);
-	staging->unmap();
+	const VkDeviceSize position = allocStaging(size);
+	stagingOffset = position % m_stagingRingSize;
+	openStagingBatch(position);
 
-	auto commandBufferStaging = std::make_shared<CommandBuffer>(m_defaultCommandPool);
-	commandBufferStaging->create(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	memcpy((char*)m_stagingRing->m_mappedAddress + stagingOffset, srcData, (size_t)size);
+	// ring size and offset are both multiples of nonCoherentAtomSize, so the rounded up range stays inside
+	const VkDeviceSize flushSize = (size + m_stagingAlignment - 1) / m_stagingAlignment * m_stagingAlignment;
+	m_stagingRing->flush(true, stagingOffset, flushSize);
+	return *m_stagingRing;
+}
 
-	commandBufferStaging->begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-	commandBufferStaging->copyBuffer(*staging, dstBuffer, size, srcOffset, dstOffset);
-	commandBufferStaging->end();
+VkDeviceSize GraphicContext::allocStaging(VkDeviceSize size)
+{
+	if (!m_stagingRing)
+	{
+		const VkPhysicalDeviceLimits& limits = m_vulkanSetup.device_properties.limits;
+		m_stagingAlignment = std::max<VkDeviceSize>({ 16, limits.nonCoherentAtomSize, limits.optimalBufferCopyOffsetAlignment });
+		m_stagingRingSize = (m_stagingRingSize + m_stagingAlignment - 1) / m_stagingAlignment * m_stagingAlignment;
 
-	m_stagingCommandBuffers.push_back(std::move(commandBufferStaging));
+		m_stagingRing = std::make_unique<Buffer>(m_vulkanSetup);
+		m_stagingRing->create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, m_stagingRingSize, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		m_stagingRing->map();
+	}
+
+	while (true)
+	{
+		VkDeviceSize position = (m_stagingHead + m_stagingAlignment - 1) / m_stagingAlignment * m_stagingAlignment;
+		if (position % m_stagingRingSize + size > m_stagingRingSize)
+			position = (position / m_stagingRingSize + 1) * m_stagingRingSize; // does not fit before the end, wrap around
+
+		VkDeviceSize tail = position; // nothing open or in flight, so the whole ring is free
+		if (!m_stagingInFlight.empty()) tail = m_stagingInFlight.front()->m_begin;
+		else if (m_stagingOpen) tail = m_stagingOpen->m_begin;
+
+		if (position + size - tail <= m_stagingRingSize)
+		{
+			m_stagingHead = position + size;
+			return position;
+		}
+
+		// ring is full: wait for the oldest submitted batch, or submit the one being recorded if it holds all of it
+		if (!m_stagingInFlight.empty())
+			retireStaging(true);
+		else
+			submitStaging(true, { }, { }, false);
+	}
+}
+
+GraphicContext::StagingBatch& GraphicContext::openStagingBatch(VkDeviceSize begin)
+{
+	if (m_stagingOpen)
+		return *m_stagingOpen;
+
+	retireStaging(false);
+	if (!m_stagingFree.empty())
+	{
+		m_stagingOpen = std::move(m_stagingFree.back());
+		m_stagingFree.pop_back();
+	}
+	else
+	{
+		m_stagingOpen = std::make_unique<StagingBatch>();
+		m_stagingOpen->m_commandBuffer = std::make_shared<CommandBuffer>(m_defaultCommandPool);
+		m_stagingOpen->m_commandBuffer->create(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+		VkFenceCreateInfo fenceInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
+		VkResult result = vkCreateFence(m_vulkanSetup.device, &fenceInfo, nullptr, &m_stagingOpen->m_fence);
+		check(result);
+	}
+	m_stagingOpen->m_begin = begin;
+	m_stagingOpen->m_commandBuffer->begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+	m_stagingCommandBuffers.push_back(m_stagingOpen->m_commandBuffer);
+
+	return *m_stagingOpen;
+}
+
+void GraphicContext::retireStaging(bool wait)
+{
+	while (!m_stagingInFlight.empty())
+	{
+		StagingBatch& batch = *m_stagingInFlight.front();
+		if (wait)
+		{
+			VkResult result = vkWaitForFences(m_vulkanSetup.device, 1, &batch.m_fence, VK_TRUE, UINT64_MAX);
+			check(result);
+			wait = false;
+		}
+		else if (vkGetFenceStatus(m_vulkanSetup.device, batch.m_fence) != VK_SUCCESS)
+		{
+			break;
+		}
+
+		VkResult result = vkResetFences(m_vulkanSetup.device, 1, &batch.m_fence);
+		check(result);
+		batch.m_dedicated.clear();
+		m_stagingFree.push_back(std::move(m_stagingInFlight.front()));
+		m_stagingInFlight.pop_front();
+	}
+}
+
+void GraphicContext::destroyStaging()
+{
+	if (!m_stagingInFlight.empty())
+	{
+		VkResult result = vkWaitForFences(m_vulkanSetup.device, 1, &m_stagingInFlight.back()->m_fence, VK_TRUE, UINT64_MAX);
+		check(result);
+	}
+	if (m_stagingOpen) m_stagingInFlight.push_back(std::move(m_stagingOpen));
+	for (auto& batch : m_stagingInFlight) m_stagingFree.push_back(std::move(batch));
+	m_stagingInFlight.clear();
+
+	m_stagingCommandBuffers.clear();
+	for (auto& batch : m_stagingFree)
+	{
+		vkDestroyFence(m_vulkanSetup.device, batch->m_fence, nullptr);
+	}
+	m_stagingFree.clear();
+	m_stagingRing = nullptr;
+	m_stagingHead = 0;
+}
+
+void GraphicContext::updateBuffer(const char* srcData, VkDeviceSize size, const Buffer& dstBuffer, VkDeviceSize dstOffset /*=0*/, VkDeviceSize srcOffset /*=0*/, bool submitOnce /*=false*/ )
+{
+	VkDeviceSize stagingOffset = 0;
+	const Buffer& staging = stageData(srcData, size, stagingOffset);
+
+	m_stagingOpen->m_commandBuffer->copyBuffer(staging, dstBuffer, size, stagingOffset + srcOffset, dstOffset);
 
 	// submit the command buffer immediately
 	if (submitOnce)
 		submitStaging(true, { }, { }, false);
-
-	m_usingBuffers.push_back(std::move(staging));
 }
 
 void GraphicContext::updateImage(const char* srcData, VkDeviceSize size, Image& dstImage, const VkExtent3D& dstExtent, const VkOffset3D & dstOffset /*={0,0,0}*/, VkDeviceSize srcOffset /*=0*/, bool submitOnce /*=false*/)
 {
-	auto staging = std::make_unique<Buffer>(m_vulkanSetup);
-	staging->create(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-	staging->map();
-	memcpy(staging->m_mappedAddress, srcData, (size_t)size);
-	staging->flush(true);
-	staging->unmap();
+	VkDeviceSize stagingOffset = 0;
+	const Buffer& staging = stageData(srcData, size, stagingOffset);
 
-	auto commandBufferStaging = std::make_shared<CommandBuffer>(m_defaultCommandPool);
-	commandBufferStaging->create(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
-
-	commandBufferStaging->begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-	commandBufferStaging->imageMemoryBarrier(dstImage, dstImage.m_imageLayout,
+	CommandBuffer& commandBufferStaging = *m_stagingOpen->m_commandBuffer;
+	commandBufferStaging.imageMemoryBarrier(dstImage, dstImage.m_imageLayout,
 	        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT,
 	        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
 
 	//before copyBufferToImage, host should make sure the right layout of image
-	commandBufferStaging->copyBufferToImage(*staging, dstImage, srcOffset, dstExtent, dstOffset);
+	commandBufferStaging.copyBufferToImage(staging, dstImage, stagingOffset + srcOffset, dstExtent, dstOffset);
 
 	//just workround : layout -> shader_read_only.  To be fixed
-	commandBufferStaging->imageMemoryBarrier(dstImage, dstImage.m_imageLayout,
+	commandBufferStaging.imageMemoryBarrier(dstImage, dstImage.m_imageLayout,
 	        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
 	        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 
-	commandBufferStaging->end();
-
-	m_stagingCommandBuffers.push_back(std::move(commandBufferStaging));
-
 	// submit the command buffer immediately
 	if (submitOnce)
 		submitStaging(true, { }, { }, false);
-
-	m_usingBuffers.push_back(std::move(staging));
 }
 
 VkSemaphore GraphicContext::submitStaging(     bool waitFence/*=true*/,
@@ -1598,27 +1911,22 @@ VkSemaphore GraphicContext::submitStaging(     bool waitFence/*=true*/,
         const std::vector<VkPipelineStageFlags>& waitPipelineStageFlags /*={}*/,
         bool returnSignalSemaphore /*=true*/)
 {
-	if(m_stagingCommandBuffers.size() == 0)
+	if (!m_stagingOpen)
 		return VK_NULL_HANDLE;
 
-	VkFence fence = VK_NULL_HANDLE;
-	if (waitFence)
-	{
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.flags = 0;
-
-		vkCreateFence(m_vulkanSetup.device, &fenceInfo, nullptr, &fence);
-	}
-	VkSemaphore signalSemaphore = submit(m_defaultQueue, m_stagingCommandBuffers, fence, waitSemaphores,
+	m_stagingOpen->m_commandBuffer->end();
+	VkSemaphore signalSemaphore = submit(m_defaultQueue, m_stagingCommandBuffers, m_stagingOpen->m_fence, waitSemaphores,
 	                                     waitPipelineStageFlags, returnSignalSemaphore, false);
-	if (fence != VK_NULL_HANDLE)
+	m_stagingCommandBuffers.clear();
+	m_stagingInFlight.push_back(std::move(m_stagingOpen));
+
+	if (waitFence)
 	{
-		VkResult result = vkWaitForFences(m_vulkanSetup.device, 1, &fence, VK_TRUE, UINT64_MAX);
+		// the fence also covers everything submitted to the queue before it
+		VkResult result = vkWaitForFences(m_vulkanSetup.device, 1, &m_stagingInFlight.back()->m_fence, VK_TRUE, UINT64_MAX);
 		check(result);
-		vkDestroyFence(m_vulkanSetup.device, fence, nullptr);
-		m_stagingCommandBuffers.clear();
 	}
+	retireStaging(false);
 
 	return signalSemaphore;
 }
@@ -1692,6 +2000,12 @@ VkResult BasicContext::initBasic(vulkan_setup_t& vulkan, vulkan_req_t& reqs)
 	height = static_cast<uint32_t>(std::get<int>(reqs.options.at("height")));
 	wg_size = static_cast<uint32_t>(std::get<int>(reqs.options.at("wg_size")));
 
+	if (reqs.options.count("suballocate"))
+	{
+		m_memoryAllocator = std::make_shared<MemoryAllocator>(vulkan);
+		MemoryAllocator::setCurrent(m_memoryAllocator);
+	}
+
 	m_defaultCommandPool = std::make_shared<CommandBufferPool>(vulkan.device);
 	m_frameBoundaryCommandBuffer = std::make_shared<CommandBuffer>(m_defaultCommandPool);
 	m_defaultCommandBuffer = std::make_shared<CommandBuffer>(m_defaultCommandPool);
@@ -1726,22 +2040,3 @@ VkResult BasicContext::initBasic(vulkan_setup_t& vulkan, vulkan_req_t& reqs)
 
 	return result;
 }
-
-std::vector<char> readFile(const std::string& filename)
-{
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open())
-	{
-		fprintf(stderr, "failed to open file %s.\n", filename.c_str());
-	}
-	assert(file.is_open());
-
-	size_t fileSize = (size_t) file.tellg();
-	std::vector<char> buffer(fileSize);
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-
-	file.close();
-	return buffer;
-}
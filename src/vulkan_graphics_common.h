@@ -3,6 +3,8 @@
 #include "vulkan_common.h"
 #include <memory>
 #include <functional>
+#include <deque>
+#include <set>
 
 namespace tracetooltests
 {
@@ -11,6 +13,71 @@ class RenderPass;
 class FrameBuffer;
 class GraphicPipeline;
 
+/// Opt-in buddy allocator handing out pieces of large VkDeviceMemory blocks to Buffer and Image,
+/// instead of one vkAllocateMemory per resource. Enabled with -sa/--suballocate.
+class MemoryAllocator
+{
+public:
+	struct Allocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr; // address of offset if the block is host visible (blocks stay mapped)
+		uint32_t pool = 0;
+		uint32_t block = 0;
+		uint32_t order = 0;
+	};
+
+	MemoryAllocator(const vulkan_setup_t& vulkan, VkDeviceSize blockSize = 64 * 1024 * 1024);
+	~MemoryAllocator();
+
+	/// Returns false if the request does not fit in a block, the caller should then allocate it on its own.
+	/// Linear and optimal tiling resources never share a block, so bufferImageGranularity does not apply.
+	bool allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool optimal, bool deviceAddress, Allocation& allocation);
+	void free(Allocation& allocation);
+
+	inline uint32_t getBlockCount() const {
+		return m_blockCount;
+	}
+	/// Number of successful allocate() calls so far, freed allocations included
+	inline uint32_t getTotalAllocations() const {
+		return m_totalAllocations;
+	}
+
+	/// The allocator Buffer and Image pick up on create(), nullptr for one allocation per resource
+	static void setCurrent(std::shared_ptr<MemoryAllocator> allocator);
+	static std::shared_ptr<MemoryAllocator> current();
+
+	VkDevice m_device;
+
+private:
+	struct Block
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void* mapped = nullptr;
+		std::vector<std::set<VkDeviceSize>> freeLists; // free offsets per order, from m_minOrder upwards
+	};
+	struct Pool
+	{
+		uint32_t memoryTypeIndex = 0;
+		bool optimal = false;
+		bool deviceAddress = false;
+		std::vector<Block> blocks;
+	};
+
+	bool allocateBlock(Pool& pool);
+
+	uint32_t m_apiVersion;
+	VkPhysicalDeviceMemoryProperties m_memoryProperties = {};
+	uint32_t m_minOrder = 8; // 256 bytes, the largest nonCoherentAtomSize allowed
+	uint32_t m_maxOrder;
+	std::vector<Pool> m_pools;
+	uint32_t m_blockCount = 0;
+	uint32_t m_totalAllocations = 0;
+	std::mutex m_mutex;
+};
+
 class Buffer
 {
 public:
@@ -27,7 +94,8 @@ public:
 
 	VkResult create(VkBufferUsageFlags usage, VkDeviceSize size, VkMemoryPropertyFlags properties, const std::vector<uint32_t>& queueFamilyIndices = { } );
 	VkResult map(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE, VkMemoryMapFlags flag = 0);
-	void flush(bool extra); // flush mapped area (must be mapped!), 'extra' means flush is for information purposes and can be omitted
+	// flush mapped area (must be mapped!), 'extra' means flush is for information purposes and can be omitted
+	void flush(bool extra, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
 	void unmap();
 	VkDeviceAddress getBufferDeviceAddress();
 
@@ -39,6 +107,9 @@ public:
 	inline VkDeviceMemory getMemory() const {
 		return m_memory;
 	}
+	inline VkDeviceSize getMemoryOffset() const {
+		return m_allocation.offset;
+	}
 	inline VkMemoryPropertyFlags getMemoryProperty() const {
 		return m_memoryProperty;
 	}
@@ -53,11 +124,13 @@ public:
 	void* m_mappedAddress = nullptr;
 
 private:
-	VkResult create();
+	VkResult create(bool suballocate = false);
 
 	bool emit_extra_flushes = false;
 	VkBuffer m_handle = VK_NULL_HANDLE;
 	VkDeviceMemory m_memory = VK_NULL_HANDLE;
+	std::shared_ptr<MemoryAllocator> m_allocator; // set if m_memory is suballocated
+	MemoryAllocator::Allocation m_allocation;
 	VkMemoryPropertyFlags m_memoryProperty = VK_MEMORY_PROPERTY_FLAG_BITS_MAX_ENUM;
 	VkDeviceAddress m_deviceAddress = 0;
 	VkDeviceSize m_size = 0;
@@ -114,6 +187,9 @@ public:
 	inline VkDeviceMemory getMemory() const {
 		return m_memory;
 	}
+	inline VkDeviceSize getMemoryOffset() const {
+		return m_allocation.offset;
+	}
 	inline VkImageCreateInfo getCreateInfo() const {
 		return m_createInfo;
 	}
@@ -129,6 +205,8 @@ private:
 
 	VkImage m_handle = VK_NULL_HANDLE;
 	VkDeviceMemory m_memory = VK_NULL_HANDLE;
+	std::shared_ptr<MemoryAllocator> m_allocator; // set if m_memory is suballocated
+	MemoryAllocator::Allocation m_allocation;
 	VkImageCreateInfo m_createInfo { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, nullptr };
 };
 
@@ -216,9 +294,12 @@ public:
 	VkResult destroy();
 
 	VkResult begin(VkCommandBufferUsageFlags flags = 0, const CommandBuffer* baseCommandBuffer = nullptr);
+	// begin a secondary command buffer, continuing the given render pass subpass if renderPass is set
+	VkResult beginSecondary(const RenderPass* renderPass, const FrameBuffer* frameBuffer = nullptr, VkCommandBufferUsageFlags flags = 0, uint32_t subpass = 0);
 	VkResult end();
-	void beginRenderPass(const RenderPass& renderPass, const FrameBuffer& frameBuffer);
+	void beginRenderPass(const RenderPass& renderPass, const FrameBuffer& frameBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
 	void endRenderPass();
+	void executeCommands(const std::vector<std::shared_ptr<CommandBuffer>>& commandBuffers);
 	void bindPipeline(VkPipelineBindPoint bindpoint, const GraphicPipeline& pipeline);
 	void bufferMemoryBarrier(Buffer& buffer, VkDeviceSize offset, VkDeviceSize size,
                              VkAccessFlags srcAccess, VkAccessFlags dstAccess,
@@ -809,6 +890,9 @@ public:
 	VkQueue m_defaultQueue = VK_NULL_HANDLE;
 	uint32_t frameNo = 0;
 
+	// only with -sa/--suballocate
+	std::shared_ptr<MemoryAllocator> m_memoryAllocator;
+
 protected:
 	virtual ~BasicContext() {
 		destroy();
@@ -823,6 +907,13 @@ protected:
 		m_defaultCommandPool = nullptr;
 		frameNo = 0;
 
+		if (m_memoryAllocator)
+		{
+			ILOG("Suballocated %u resources in total from %u memory blocks", m_memoryAllocator->getTotalAllocations(), m_memoryAllocator->getBlockCount());
+			MemoryAllocator::setCurrent(nullptr);
+			m_memoryAllocator = nullptr;
+		}
+
 		test_done(m_vulkanSetup);
 	}
 
@@ -858,7 +949,8 @@ public:
 	                   const std::vector<VkPipelineStageFlags>& waitPipelineStageFlags = {},
 	                   bool returnSignalSemaphore = true,  bool returnFrameImage = false);
 
-	// submit the stagingCommandBuffers and waitFence if needed,, and then clear it
+	// submit the stagingCommandBuffers with the batch fence, and then clear it. The staging memory
+	// of the batch is reclaimed once the fence signals; waitFence waits for that right away.
 	VkSemaphore submitStaging(bool waitFence = true,
 	                          const std::vector<VkSemaphore>&          waitSemaphores = {},
 	                          const std::vector<VkPipelineStageFlags>& waitPipelineStageFlags = {},
@@ -870,22 +962,46 @@ public:
 		m_framebuffer = nullptr;
 		m_renderPass = nullptr;
 
+		destroyStaging();
 		for (auto semaphore : m_returnSignalSemaphores)
 		{
 			vkDestroySemaphore(m_vulkanSetup.device, semaphore, nullptr);
 		}
 		m_returnSignalSemaphores.clear();
-		m_usingBuffers.clear();
-		if (m_stagingCommandBuffers.size() > 0)
-			m_stagingCommandBuffers.clear();
 	}
 
 	std::vector<VkSemaphore> m_returnSignalSemaphores;
 	std::shared_ptr<RenderPass> m_renderPass;
 	std::shared_ptr<FrameBuffer> m_framebuffer; // vector future
 	std::vector<std::shared_ptr<CommandBuffer>> m_stagingCommandBuffers;
-	std::vector<std::unique_ptr<Buffer>> m_usingBuffers; // recyling
 
+	/// Size of the persistently mapped staging ring, created on first upload. Uploads larger
+	/// than the ring get a dedicated staging buffer that lives until its batch has completed.
+	VkDeviceSize m_stagingRingSize = 16 * 1024 * 1024;
+
+private:
+	/// One submitStaging() worth of uploads: the command buffer they were recorded into, the
+	/// fence it was submitted with, and where its space in the staging ring starts.
+	struct StagingBatch
+	{
+		std::shared_ptr<CommandBuffer> m_commandBuffer;
+		VkFence m_fence = VK_NULL_HANDLE;
+		VkDeviceSize m_begin = 0;
+		std::vector<std::unique_ptr<Buffer>> m_dedicated;
+	};
+
+	const Buffer& stageData(const char* srcData, VkDeviceSize size, VkDeviceSize& stagingOffset);
+	VkDeviceSize allocStaging(VkDeviceSize size);
+	StagingBatch& openStagingBatch(VkDeviceSize begin);
+	void retireStaging(bool wait);
+	void destroyStaging();
+
+	std::unique_ptr<Buffer> m_stagingRing;
+	VkDeviceSize m_stagingAlignment = 16;
+	VkDeviceSize m_stagingHead = 0; // ring positions only ever grow, offset in the buffer is position % size
+	std::unique_ptr<StagingBatch> m_stagingOpen; // being recorded
+	std::deque<std::unique_ptr<StagingBatch>> m_stagingInFlight; // submitted, oldest first
+	std::vector<std::unique_ptr<StagingBatch>> m_stagingFree; // retired, for reuse
 };
 
 
@@ -897,4 +1013,3 @@ public:
 
 void usage();
 bool parseCmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs);
-std::vector<char> readFile(const std::string& filename);
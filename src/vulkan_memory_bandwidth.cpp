@@ -0,0 +1,276 @@
+// Benchmark for writing to persistently mapped memory between submits. Tracers have to track which parts
+// of mapped memory the app changes, using eg guard pages, mprotect or userfaultfd, and then scan or flush
+// those changes on each submit. This measures the write bandwidth the app sees and the per-submit cost.
+
+#include "vulkan_common.h"
+
+enum write_pattern
+{
+	PATTERN_SEQUENTIAL,
+	PATTERN_STRIDED,
+	PATTERN_RANDOM_PAGES,
+	PATTERN_SPARSE_BYTES,
+	PATTERN_COUNT
+};
+
+static const char* pattern_names[PATTERN_COUNT] = { "sequential", "strided", "random pages", "sparse bytes" };
+
+static int pattern = PATTERN_SEQUENTIAL;
+static int size_mb = 64;
+static int stride = 1024;
+static int loops = 20;
+static bool non_coherent = false;
+
+static const unsigned page_size = 4096;
+static const unsigned chunk_size = 64; // bytes written at each stride step
+
+static void show_usage()
+{
+	printf("-p/--pattern N         Write pattern (default %d)\n", pattern);
+	printf("\t0 - sequential, the whole mapping\n");
+	printf("\t1 - strided, %u bytes every stride\n", chunk_size);
+	printf("\t2 - random %u byte pages, a quarter of the mapping\n", page_size);
+	printf("\t3 - sparse single bytes in random pages, a quarter of the pages\n");
+	printf("-s/--size N            Size of the mapped memory in megabytes (default %d)\n", size_mb);
+	printf("-S/--stride N          Stride in bytes for the strided pattern (default %d)\n", stride);
+	printf("-l/--loops N           Number of submits to run (default %d)\n", loops);
+	printf("-n/--non-coherent      Use host cached, non-coherent memory and flush it explicitly\n");
+}
+
+static bool test_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
+{
+	if (match(argv[i], "-p", "--pattern"))
+	{
+		pattern = get_arg(argv, ++i, argc);
+		return pattern >= 0 && pattern < PATTERN_COUNT;
+	}
+	else if (match(argv[i], "-s", "--size"))
+	{
+		size_mb = get_arg(argv, ++i, argc);
+		return size_mb > 0;
+	}
+	else if (match(argv[i], "-S", "--stride"))
+	{
+		stride = get_arg(argv, ++i, argc);
+		return stride >= (int)chunk_size;
+	}
+	else if (match(argv[i], "-l", "--loops"))
+	{
+		loops = get_arg(argv, ++i, argc);
+		return loops > 0;
+	}
+	else if (match(argv[i], "-n", "--non-coherent"))
+	{
+		non_coherent = true;
+		return true;
+	}
+	return false;
+}
+
+// simple deterministic generator so that every run touches the same pages
+static inline uint32_t next_random(uint32_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+/// Write the chosen pattern into the mapped memory and return the number of bytes written.
+static uint64_t write_pattern(char* ptr, uint64_t size, int frame)
+{
+	const uint64_t value = 0x0101010101010101ull * (frame & 0xff);
+	const uint64_t pages = size / page_size;
+	uint32_t seed = 1234567 + frame;
+	uint64_t written = 0;
+
+	switch (pattern)
+	{
+	case PATTERN_SEQUENTIAL:
+		for (uint64_t i = 0; i < size / sizeof(uint64_t); i++) ((volatile uint64_t*)ptr)[i] = value;
+		written = size;
+		break;
+	case PATTERN_STRIDED:
+		for (uint64_t offset = 0; offset + chunk_size <= size; offset += stride)
+		{
+			for (unsigned i = 0; i < chunk_size / sizeof(uint64_t); i++) ((volatile uint64_t*)(ptr + offset))[i] = value;
+			written += chunk_size;
+		}
+		break;
+	case PATTERN_RANDOM_PAGES:
+		for (uint64_t p = 0; p < pages / 4; p++)
+		{
+			volatile uint64_t* page = (volatile uint64_t*)(ptr + (next_random(seed) % pages) * page_size);
+			for (unsigned i = 0; i < page_size / sizeof(uint64_t); i++) page[i] = value;
+			written += page_size;
+		}
+		break;
+	case PATTERN_SPARSE_BYTES:
+		for (uint64_t p = 0; p < pages / 4; p++)
+		{
+			const uint32_t r = next_random(seed);
+			((volatile char*)ptr)[(r % pages) * page_size + (r >> 20) % page_size] = (char)frame;
+			written++;
+		}
+		break;
+	default:
+		assert(false);
+		break;
+	}
+	return written;
+}
+
+int main(int argc, char** argv)
+{
+	vulkan_req_t reqs;
+	reqs.usage = show_usage;
+	reqs.cmdopt = test_cmdopt;
+	vulkan_setup_t vulkan = test_init(argc, argv, "vulkan_memory_bandwidth", reqs);
+	const VkDeviceSize size = (VkDeviceSize)size_mb * 1024 * 1024;
+	VkResult result;
+
+	VkQueue queue;
+	vkGetDeviceQueue(vulkan.device, 0, 0, &queue);
+
+	// The mapped buffer, copied from in a small amount on each submit so that the GPU actually uses it
+	VkBuffer buffer;
+	VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, nullptr };
+	bufferCreateInfo.size = size;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	result = vkCreateBuffer(vulkan.device, &bufferCreateInfo, nullptr, &buffer);
+	check(result);
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(vulkan.device, buffer, &req);
+
+	VkPhysicalDeviceMemoryProperties memory_properties = {};
+	vkGetPhysicalDeviceMemoryProperties(vulkan.physical, &memory_properties);
+	uint32_t memoryTypeIndex = UINT32_MAX;
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
+	{
+		const VkMemoryPropertyFlags flags = memory_properties.memoryTypes[i].propertyFlags;
+		if (!(req.memoryTypeBits & (1 << i)) || !(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) continue;
+		if (non_coherent && (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) continue;
+		if (!non_coherent && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) continue;
+		memoryTypeIndex = i;
+		break;
+	}
+	if (memoryTypeIndex == UINT32_MAX)
+	{
+		printf("No %s host visible memory type found\n", non_coherent ? "non-coherent" : "coherent");
+		exit(77);
+	}
+
+	VkMemoryAllocateInfo pAllocateMemInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr };
+	pAllocateMemInfo.memoryTypeIndex = memoryTypeIndex;
+	pAllocateMemInfo.allocationSize = req.size;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	result = vkAllocateMemory(vulkan.device, &pAllocateMemInfo, nullptr, &memory);
+	check(result);
+	result = vkBindBufferMemory(vulkan.device, buffer, memory, 0);
+	check(result);
+
+	VkBuffer target;
+	bufferCreateInfo.size = page_size;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	result = vkCreateBuffer(vulkan.device, &bufferCreateInfo, nullptr, &target);
+	check(result);
+	vkGetBufferMemoryRequirements(vulkan.device, target, &req);
+	pAllocateMemInfo.memoryTypeIndex = get_device_memory_type(req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	pAllocateMemInfo.allocationSize = req.size;
+	VkDeviceMemory target_memory = VK_NULL_HANDLE;
+	result = vkAllocateMemory(vulkan.device, &pAllocateMemInfo, nullptr, &target_memory);
+	check(result);
+	result = vkBindBufferMemory(vulkan.device, target, target_memory, 0);
+	check(result);
+
+	VkCommandPool pool;
+	VkCommandPoolCreateInfo cmdcreateinfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr };
+	cmdcreateinfo.queueFamilyIndex = 0;
+	result = vkCreateCommandPool(vulkan.device, &cmdcreateinfo, nullptr, &pool);
+	check(result);
+	VkCommandBuffer cmd;
+	VkCommandBufferAllocateInfo pAllocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr };
+	pAllocateInfo.commandBufferCount = 1;
+	pAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	pAllocateInfo.commandPool = pool;
+	result = vkAllocateCommandBuffers(vulkan.device, &pAllocateInfo, &cmd);
+	check(result);
+	VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr };
+	result = vkBeginCommandBuffer(cmd, &beginInfo);
+	check(result);
+	VkBufferCopy region = { 0, 0, page_size };
+	vkCmdCopyBuffer(cmd, buffer, target, 1, &region);
+	result = vkEndCommandBuffer(cmd);
+	check(result);
+
+	VkFence fence;
+	VkFenceCreateInfo fence_create_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
+	result = vkCreateFence(vulkan.device, &fence_create_info, nullptr, &fence);
+	check(result);
+
+	// Map once and keep it mapped for the lifetime of the test
+	char* ptr = nullptr;
+	result = vkMapMemory(vulkan.device, memory, 0, VK_WHOLE_SIZE, 0, (void**)&ptr);
+	check(result);
+
+	uint64_t bytes_written = 0;
+	uint64_t write_time = 0;
+	uint64_t flush_time = 0;
+	uint64_t submit_time = 0;
+	bench_reserve(vulkan.bench, 3 * loops); // write, flush and submit samples for each frame
+	for (int frame = 0; frame < loops; frame++)
+	{
+		bench_start_scene(vulkan.bench, "write");
+		bench_start_iteration(vulkan.bench);
+		uint64_t start = gettime();
+		bytes_written += write_pattern(ptr, size, frame);
+		write_time += gettime() - start;
+		bench_stop_iteration(vulkan.bench);
+		bench_stop_scene(vulkan.bench);
+
+		bench_start_scene(vulkan.bench, "flush");
+		bench_start_iteration(vulkan.bench);
+		start = gettime();
+		if (non_coherent || vulkan.has_explicit_host_updates) testFlushMemory(vulkan, memory, 0, VK_WHOLE_SIZE, vulkan.has_explicit_host_updates);
+		flush_time += gettime() - start;
+		bench_stop_iteration(vulkan.bench);
+		bench_stop_scene(vulkan.bench);
+
+		bench_start_scene(vulkan.bench, "submit");
+		bench_start_iteration(vulkan.bench);
+		start = gettime();
+		VkSubmitInfo submit_info = { VK_STRUCTURE_TYPE_SUBMIT_INFO, nullptr };
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &cmd;
+		result = vkQueueSubmit(queue, 1, &submit_info, fence);
+		check(result);
+		submit_time += gettime() - start;
+		bench_stop_iteration(vulkan.bench);
+		bench_stop_scene(vulkan.bench);
+
+		result = vkWaitForFences(vulkan.device, 1, &fence, VK_TRUE, UINT64_MAX);
+		check(result);
+		result = vkResetFences(vulkan.device, 1, &fence);
+		check(result);
+	}
+
+	printf("%s writes to %d MB of %s memory, %d submits\n", pattern_names[pattern], size_mb, non_coherent ? "non-coherent" : "coherent", loops);
+	printf("Write: %.3f ms per frame, %.1f MB written per frame, %.3f GB/s\n", write_time / 1000000.0 / loops,
+	       bytes_written / 1024.0 / 1024.0 / loops, (double)bytes_written / write_time);
+	printf("Flush: %.3f ms per submit\n", flush_time / 1000000.0 / loops);
+	printf("Submit: %.3f ms per submit\n", submit_time / 1000000.0 / loops);
+
+	// Cleanup...
+	vkUnmapMemory(vulkan.device, memory);
+	vkDestroyFence(vulkan.device, fence, nullptr);
+	vkFreeCommandBuffers(vulkan.device, pool, 1, &cmd);
+	vkDestroyCommandPool(vulkan.device, pool, nullptr);
+	vkDestroyBuffer(vulkan.device, target, nullptr);
+	testFreeMemory(vulkan, target_memory);
+	vkDestroyBuffer(vulkan.device, buffer, nullptr);
+	testFreeMemory(vulkan, memory);
+
+	test_done(vulkan);
+	return 0;
+}
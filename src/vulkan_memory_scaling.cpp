@@ -0,0 +1,189 @@
+// Scaling test for large numbers of buffers or images. Creates the objects in ten batches, binds them either
+// into a handful of large allocations or into one dedicated allocation each, then destroys them, and reports
+// the time per object and the resident memory growth of the process after each batch. Tracer handle tables
+// and shadow memory structures that degrade with object count show up as rising per-batch times.
+
+#include "vulkan_common.h"
+
+static int count = 10000;
+static bool images = false;
+static bool dedicated = false;
+
+static const int batches = 10;
+static const int allocations = 8; // number of large allocations when not using dedicated allocations
+
+static void show_usage()
+{
+	printf("-c/--count N           Number of objects to create (default %d)\n", count);
+	printf("-i/--images            Create images instead of buffers\n");
+	printf("-D/--dedicated         Use one dedicated allocation for each object, capped by maxMemoryAllocationCount\n");
+}
+
+static bool test_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
+{
+	if (match(argv[i], "-c", "--count"))
+	{
+		count = get_arg(argv, ++i, argc);
+		return count >= batches;
+	}
+	else if (match(argv[i], "-i", "--images"))
+	{
+		images = true;
+		return true;
+	}
+	else if (match(argv[i], "-D", "--dedicated"))
+	{
+		dedicated = true;
+		return true;
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	vulkan_req_t reqs;
+	reqs.usage = show_usage;
+	reqs.cmdopt = test_cmdopt;
+	reqs.apiVersion = VK_API_VERSION_1_1; // for dedicated allocations
+	reqs.minApiVersion = VK_API_VERSION_1_1;
+	vulkan_setup_t vulkan = test_init(argc, argv, "vulkan_memory_scaling", reqs);
+	VkResult result;
+
+	if (dedicated && (uint32_t)count > vulkan.device_properties.limits.maxMemoryAllocationCount - 100)
+	{
+		count = vulkan.device_properties.limits.maxMemoryAllocationCount - 100;
+		printf("Capping object count at %d to stay within maxMemoryAllocationCount\n", count);
+	}
+	const int batch_size = count / batches;
+	count = batch_size * batches;
+
+	VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, nullptr };
+	bufferCreateInfo.size = 256;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkImageCreateInfo imageCreateInfo = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, nullptr };
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+	imageCreateInfo.extent = { 16, 16, 1 };
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	std::vector<VkBuffer> buffers(images ? 0 : count);
+	std::vector<VkImage> imagelist(images ? count : 0);
+	std::vector<VkDeviceMemory> memory;
+	const long rss_start = get_rss();
+	printf("%d %s, %s, RSS at start %ld kB\n", count, images ? "images" : "buffers", dedicated ? "dedicated allocations" : "shared allocations", rss_start);
+
+	bench_reserve(vulkan.bench, 3 * batches); // one sample per batch for create, bind and destroy
+	bench_start_scene(vulkan.bench, "create");
+	uint64_t create_time = 0;
+	for (int b = 0; b < batches; b++)
+	{
+		bench_start_iteration(vulkan.bench);
+		const uint64_t start = gettime();
+		for (int i = b * batch_size; i < (b + 1) * batch_size; i++)
+		{
+			if (images) result = vkCreateImage(vulkan.device, &imageCreateInfo, nullptr, &imagelist[i]);
+			else result = vkCreateBuffer(vulkan.device, &bufferCreateInfo, nullptr, &buffers[i]);
+			check(result);
+		}
+		const uint64_t elapsed = gettime() - start;
+		create_time += elapsed;
+		bench_stop_iteration(vulkan.bench);
+		printf("\tcreate batch %d: %.1f ns per object, RSS %ld kB\n", b, (double)elapsed / batch_size, get_rss());
+	}
+	bench_stop_scene(vulkan.bench);
+
+	// All objects are identical, so the first one tells us the requirements for all of them
+	VkMemoryRequirements req;
+	if (images) vkGetImageMemoryRequirements(vulkan.device, imagelist[0], &req);
+	else vkGetBufferMemoryRequirements(vulkan.device, buffers[0], &req);
+	const VkDeviceSize object_size = aligned_size(req.size, req.alignment);
+	const int per_allocation = (count + allocations - 1) / allocations;
+	VkMemoryAllocateInfo pAllocateMemInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr };
+	pAllocateMemInfo.memoryTypeIndex = get_device_memory_type(req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	if (!dedicated)
+	{
+		memory.resize(allocations);
+		pAllocateMemInfo.allocationSize = object_size * per_allocation;
+		for (VkDeviceMemory& m : memory)
+		{
+			result = vkAllocateMemory(vulkan.device, &pAllocateMemInfo, nullptr, &m);
+			check(result);
+		}
+	}
+	else memory.resize(count);
+
+	bench_start_scene(vulkan.bench, "bind");
+	uint64_t bind_time = 0;
+	for (int b = 0; b < batches; b++)
+	{
+		bench_start_iteration(vulkan.bench);
+		const uint64_t start = gettime();
+		for (int i = b * batch_size; i < (b + 1) * batch_size; i++)
+		{
+			VkDeviceMemory target;
+			VkDeviceSize offset = 0;
+			if (dedicated)
+			{
+				VkMemoryDedicatedAllocateInfo mdai = { VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO, nullptr };
+				if (images) mdai.image = imagelist[i];
+				else mdai.buffer = buffers[i];
+				pAllocateMemInfo.pNext = &mdai;
+				pAllocateMemInfo.allocationSize = req.size;
+				result = vkAllocateMemory(vulkan.device, &pAllocateMemInfo, nullptr, &memory[i]);
+				check(result);
+				target = memory[i];
+			}
+			else
+			{
+				target = memory[i / per_allocation];
+				offset = (i % per_allocation) * object_size;
+			}
+			if (images) result = vkBindImageMemory(vulkan.device, imagelist[i], target, offset);
+			else result = vkBindBufferMemory(vulkan.device, buffers[i], target, offset);
+			check(result);
+		}
+		const uint64_t elapsed = gettime() - start;
+		bind_time += elapsed;
+		bench_stop_iteration(vulkan.bench);
+		printf("\tbind batch %d: %.1f ns per object, RSS %ld kB\n", b, (double)elapsed / batch_size, get_rss());
+	}
+	bench_stop_scene(vulkan.bench);
+	const long rss_peak = get_rss();
+
+	bench_start_scene(vulkan.bench, "destroy");
+	uint64_t destroy_time = 0;
+	for (int b = 0; b < batches; b++)
+	{
+		bench_start_iteration(vulkan.bench);
+		const uint64_t start = gettime();
+		for (int i = b * batch_size; i < (b + 1) * batch_size; i++)
+		{
+			if (images) vkDestroyImage(vulkan.device, imagelist[i], nullptr);
+			else vkDestroyBuffer(vulkan.device, buffers[i], nullptr);
+			if (dedicated) testFreeMemory(vulkan, memory[i]);
+		}
+		const uint64_t elapsed = gettime() - start;
+		destroy_time += elapsed;
+		bench_stop_iteration(vulkan.bench);
+		printf("\tdestroy batch %d: %.1f ns per object, RSS %ld kB\n", b, (double)elapsed / batch_size, get_rss());
+	}
+	bench_stop_scene(vulkan.bench);
+	if (!dedicated) for (VkDeviceMemory m : memory) testFreeMemory(vulkan, m);
+
+	printf("Create: %.1f ns per object\n", (double)create_time / count);
+	printf("Bind: %.1f ns per object\n", (double)bind_time / count);
+	printf("Destroy: %.1f ns per object\n", (double)destroy_time / count);
+	printf("RSS growth: %ld kB at peak (%.1f bytes per object), %ld kB after destroy\n", rss_peak - rss_start,
+	       (rss_peak - rss_start) * 1024.0 / count, get_rss() - rss_start);
+
+	test_done(vulkan);
+	return 0;
+}
@@ -0,0 +1,283 @@
+// Presentation throughput test on a headless surface. Acquires a swapchain image, clears it and presents it
+// as fast as the present mode allows. Since tracers usually do their per-frame work at present time, this
+// isolates that fixed per-frame overhead, and it runs without a display.
+
+#include <algorithm>
+
+#include "vulkan_window_common.h"
+
+static int image_count = 3;
+static int present_mode = VK_PRESENT_MODE_FIFO_KHR;
+static int loops = 1000;
+static uint32_t width = 640;
+static uint32_t height = 480;
+
+static const char* present_mode_names[] = { "immediate", "mailbox", "fifo", "fifo relaxed" };
+
+static void show_usage()
+{
+	printf("-i/--images N          Number of swapchain images (default %d)\n", image_count);
+	printf("-p/--present-mode N    Present mode (default %d)\n", present_mode);
+	for (int i = 0; i < 4; i++) printf("\t%d - %s\n", i, present_mode_names[i]);
+	printf("-l/--loops N           Number of frames to present (default %d)\n", loops);
+	printf("-W/--width N           Width of swapchain images (default %u)\n", width);
+	printf("-H/--height N          Height of swapchain images (default %u)\n", height);
+}
+
+static bool test_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
+{
+	if (match(argv[i], "-i", "--images"))
+	{
+		image_count = get_arg(argv, ++i, argc);
+		return image_count > 0;
+	}
+	else if (match(argv[i], "-p", "--present-mode"))
+	{
+		present_mode = get_arg(argv, ++i, argc);
+		return present_mode >= VK_PRESENT_MODE_IMMEDIATE_KHR && present_mode <= VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+	}
+	else if (match(argv[i], "-l", "--loops"))
+	{
+		loops = get_arg(argv, ++i, argc);
+		return loops > 0;
+	}
+	else if (match(argv[i], "-W", "--width"))
+	{
+		width = get_arg(argv, ++i, argc);
+		return width > 0;
+	}
+	else if (match(argv[i], "-H", "--height"))
+	{
+		height = get_arg(argv, ++i, argc);
+		return height > 0;
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	vulkan_req_t reqs;
+	reqs.usage = show_usage;
+	reqs.cmdopt = test_cmdopt;
+	reqs.instance_extensions.push_back("VK_EXT_headless_surface");
+	reqs.device_extensions.push_back("VK_KHR_swapchain");
+	vulkan_setup_t vulkan = test_init(argc, argv, "vulkan_present_1", reqs);
+	VkResult result;
+
+	testwindow w = test_window_create_headless(vulkan);
+
+	VkBool32 supported = VK_FALSE;
+	result = vkGetPhysicalDeviceSurfaceSupportKHR(vulkan.physical, 0, w.surface, &supported);
+	check(result);
+	if (!supported)
+	{
+		printf("Queue family 0 cannot present to a headless surface\n");
+		exit(77);
+	}
+
+	uint32_t mode_count = 0;
+	result = vkGetPhysicalDeviceSurfacePresentModesKHR(vulkan.physical, w.surface, &mode_count, nullptr);
+	check(result);
+	std::vector<VkPresentModeKHR> modes(mode_count);
+	result = vkGetPhysicalDeviceSurfacePresentModesKHR(vulkan.physical, w.surface, &mode_count, modes.data());
+	check(result);
+	if (std::find(modes.begin(), modes.end(), (VkPresentModeKHR)present_mode) == modes.end())
+	{
+		printf("Present mode %s not supported\n", present_mode_names[present_mode]);
+		exit(77);
+	}
+
+	VkSurfaceCapabilitiesKHR caps;
+	result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vulkan.physical, w.surface, &caps);
+	check(result);
+	if (!(caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+	{
+		printf("Swapchain images cannot be cleared\n");
+		exit(77);
+	}
+	uint32_t min_images = std::max<uint32_t>(image_count, caps.minImageCount);
+	if (caps.maxImageCount > 0) min_images = std::min(min_images, caps.maxImageCount);
+	if (caps.currentExtent.width != UINT32_MAX) // otherwise the swapchain decides the size
+	{
+		width = caps.currentExtent.width;
+		height = caps.currentExtent.height;
+	}
+
+	uint32_t format_count = 0;
+	result = vkGetPhysicalDeviceSurfaceFormatsKHR(vulkan.physical, w.surface, &format_count, nullptr);
+	check(result);
+	std::vector<VkSurfaceFormatKHR> formats(format_count);
+	result = vkGetPhysicalDeviceSurfaceFormatsKHR(vulkan.physical, w.surface, &format_count, formats.data());
+	check(result);
+	assert(format_count > 0);
+
+	VkSwapchainCreateInfoKHR swapchain_info = { VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR, nullptr };
+	swapchain_info.surface = w.surface;
+	swapchain_info.minImageCount = min_images;
+	swapchain_info.imageFormat = formats[0].format;
+	swapchain_info.imageColorSpace = formats[0].colorSpace;
+	swapchain_info.imageExtent = { width, height };
+	swapchain_info.imageArrayLayers = 1;
+	swapchain_info.imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	swapchain_info.preTransform = caps.currentTransform;
+	swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	swapchain_info.presentMode = (VkPresentModeKHR)present_mode;
+	swapchain_info.clipped = VK_TRUE;
+	VkSwapchainKHR swapchain;
+	result = vkCreateSwapchainKHR(vulkan.device, &swapchain_info, nullptr, &swapchain);
+	check(result);
+
+	uint32_t count = 0;
+	result = vkGetSwapchainImagesKHR(vulkan.device, swapchain, &count, nullptr);
+	check(result);
+	std::vector<VkImage> images(count);
+	result = vkGetSwapchainImagesKHR(vulkan.device, swapchain, &count, images.data());
+	check(result);
+	printf("%u swapchain images of %u x %u, present mode %s\n", count, width, height, present_mode_names[present_mode]);
+
+	VkQueue queue;
+	vkGetDeviceQueue(vulkan.device, 0, 0, &queue);
+
+	VkCommandPool pool;
+	VkCommandPoolCreateInfo cmdcreateinfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr };
+	cmdcreateinfo.queueFamilyIndex = 0;
+	result = vkCreateCommandPool(vulkan.device, &cmdcreateinfo, nullptr, &pool);
+	check(result);
+	std::vector<VkCommandBuffer> cmds(count);
+	VkCommandBufferAllocateInfo pAllocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr };
+	pAllocateInfo.commandBufferCount = count;
+	pAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	pAllocateInfo.commandPool = pool;
+	result = vkAllocateCommandBuffers(vulkan.device, &pAllocateInfo, cmds.data());
+	check(result);
+
+	// The clear is the same every time an image comes around, so record it once for each image
+	for (uint32_t i = 0; i < count; i++)
+	{
+		VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr };
+		result = vkBeginCommandBuffer(cmds[i], &beginInfo);
+		check(result);
+		VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		VkImageMemoryBarrier barrier = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, nullptr };
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = images[i];
+		barrier.subresourceRange = range;
+		vkCmdPipelineBarrier(cmds[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		VkClearColorValue color = { { (float)i / count, 0.5f, 1.0f - (float)i / count, 1.0f } };
+		vkCmdClearColorImage(cmds[i], images[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &range);
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		vkCmdPipelineBarrier(cmds[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		result = vkEndCommandBuffer(cmds[i]);
+		check(result);
+	}
+
+	// One acquire semaphore and fence per frame slot, one render semaphore per image
+	VkSemaphoreCreateInfo semaphore_info = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, nullptr };
+	VkFenceCreateInfo fence_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
+	fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	std::vector<VkSemaphore> acquired(count);
+	std::vector<VkSemaphore> rendered(count);
+	std::vector<VkFence> fences(count);
+	std::vector<VkFence> image_fences(count, VK_NULL_HANDLE); // which slot fence last used each image
+	for (uint32_t i = 0; i < count; i++)
+	{
+		result = vkCreateSemaphore(vulkan.device, &semaphore_info, nullptr, &acquired[i]);
+		check(result);
+		result = vkCreateSemaphore(vulkan.device, &semaphore_info, nullptr, &rendered[i]);
+		check(result);
+		result = vkCreateFence(vulkan.device, &fence_info, nullptr, &fences[i]);
+		check(result);
+	}
+
+	uint64_t acquire_time = 0;
+	uint64_t acquire_max = 0;
+	uint64_t present_time = 0;
+	const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	bench_reserve(vulkan.bench, 2 * loops); // acquire and present samples for each frame
+	const uint64_t begin = gettime();
+	for (int frame = 0; frame < loops; frame++)
+	{
+		const uint32_t slot = frame % count;
+		result = vkWaitForFences(vulkan.device, 1, &fences[slot], VK_TRUE, UINT64_MAX);
+		check(result);
+
+		bench_start_scene(vulkan.bench, "acquire");
+		bench_start_iteration(vulkan.bench);
+		uint64_t start = gettime();
+		uint32_t index = 0;
+		result = vkAcquireNextImageKHR(vulkan.device, swapchain, UINT64_MAX, acquired[slot], VK_NULL_HANDLE, &index);
+		assert(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR);
+		const uint64_t elapsed = gettime() - start;
+		acquire_time += elapsed;
+		acquire_max = std::max(acquire_max, elapsed);
+		bench_stop_iteration(vulkan.bench);
+		bench_stop_scene(vulkan.bench);
+
+		// the image may still be in use by a frame from another slot
+		if (image_fences[index] != VK_NULL_HANDLE && image_fences[index] != fences[slot])
+		{
+			result = vkWaitForFences(vulkan.device, 1, &image_fences[index], VK_TRUE, UINT64_MAX);
+			check(result);
+		}
+		image_fences[index] = fences[slot];
+		result = vkResetFences(vulkan.device, 1, &fences[slot]);
+		check(result);
+
+		VkSubmitInfo submit_info = { VK_STRUCTURE_TYPE_SUBMIT_INFO, nullptr };
+		submit_info.waitSemaphoreCount = 1;
+		submit_info.pWaitSemaphores = &acquired[slot];
+		submit_info.pWaitDstStageMask = &wait_stage;
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &cmds[index];
+		submit_info.signalSemaphoreCount = 1;
+		submit_info.pSignalSemaphores = &rendered[index];
+		result = vkQueueSubmit(queue, 1, &submit_info, fences[slot]);
+		check(result);
+
+		bench_start_scene(vulkan.bench, "present");
+		bench_start_iteration(vulkan.bench);
+		start = gettime();
+		VkPresentInfoKHR present_info = { VK_STRUCTURE_TYPE_PRESENT_INFO_KHR, nullptr };
+		present_info.waitSemaphoreCount = 1;
+		present_info.pWaitSemaphores = &rendered[index];
+		present_info.swapchainCount = 1;
+		present_info.pSwapchains = &swapchain;
+		present_info.pImageIndices = &index;
+		result = vkQueuePresentKHR(queue, &present_info);
+		assert(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR);
+		present_time += gettime() - start;
+		bench_stop_iteration(vulkan.bench);
+		bench_stop_scene(vulkan.bench);
+	}
+	result = vkQueueWaitIdle(queue);
+	check(result);
+	const uint64_t total = gettime() - begin;
+
+	printf("%d presents in %.3f s, %.1f presents/sec\n", loops, total / 1000000000.0, loops * 1000000000.0 / total);
+	printf("Acquire: %.3f ms mean, %.3f ms max\n", acquire_time / 1000000.0 / loops, acquire_max / 1000000.0);
+	printf("Present: %.3f ms mean\n", present_time / 1000000.0 / loops);
+
+	// Cleanup...
+	for (uint32_t i = 0; i < count; i++)
+	{
+		vkDestroySemaphore(vulkan.device, acquired[i], nullptr);
+		vkDestroySemaphore(vulkan.device, rendered[i], nullptr);
+		vkDestroyFence(vulkan.device, fences[i], nullptr);
+	}
+	vkFreeCommandBuffers(vulkan.device, pool, cmds.size(), cmds.data());
+	vkDestroyCommandPool(vulkan.device, pool, nullptr);
+	vkDestroySwapchainKHR(vulkan.device, swapchain, nullptr);
+	test_window_destroy(vulkan, w);
+
+	test_done(vulkan);
+	return 0;
+}
@@ -0,0 +1,352 @@
+// Benchmark of command buffer recording throughput. Records millions of draws, binds, push constants
+// and barriers per frame, either straight into the primary command buffer or into secondary command
+// buffers, and times recording and submission separately.
+
+#include "vulkan_common.h"
+#include "vulkan_graphics_common.h"
+
+// reuses the vertex shader of vulkan_graphics_1, see there for how it was generated. Rasterization
+// is discarded, so there is no fragment shader and the render pass has no attachments.
+#include "vulkan_graphics_1_vert.inc"
+
+using namespace tracetooltests;
+
+static int draws = 1000000;
+static int secondaries = 0;
+static bool reuse = false;
+
+static const int rebind_interval = 64; // bind all state again every this many draws
+static const int barrier_interval = 16; // record one barrier for this many draws
+
+static void show_usage()
+{
+	usage();
+	printf("-n/--draws N           Number of draws recorded per frame (default %d)\n", draws);
+	printf("-s/--secondaries N     Record the draws into N secondary command buffers instead of the primary (default %d)\n", secondaries);
+	printf("-r/--reuse             Record once with simultaneous use, then resubmit every frame without re-recording\n");
+}
+
+static bool test_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
+{
+	if (match(argv[i], "-n", "--draws"))
+	{
+		draws = std::max(get_arg(argv, ++i, argc), 1);
+		return true;
+	}
+	else if (match(argv[i], "-s", "--secondaries"))
+	{
+		secondaries = get_arg(argv, ++i, argc);
+		if (secondaries < 0) ABORT("Bad number of secondary command buffers %d", secondaries);
+		return true;
+	}
+	else if (match(argv[i], "-r", "--reuse"))
+	{
+		reuse = true;
+		return true;
+	}
+	return parseCmdopt(i, argc, argv, reqs);
+}
+
+// ------------------------------ benchmark definition ------------------------
+typedef struct Vertex {
+	float pos[3];
+	float color[3];
+	float texCoord[2];
+} Vertex;
+
+const static std::vector<Vertex> vertices(8, Vertex{});
+
+const static std::vector<uint16_t> indices = {
+	0, 1, 2, 2, 3, 0
+};
+
+typedef struct Transform {
+	float model[16];
+	float view[16];
+	float proj[16];
+} Transform;
+
+class benchmarkContext : public GraphicContext
+{
+public:
+	benchmarkContext() : GraphicContext() {}
+	~benchmarkContext() {
+		destroy();
+	}
+	void destroy()
+	{
+		DLOG3("MEM detection: record_1 benchmark destroy().");
+		m_secondaryCommandBuffers.clear();
+		m_vertexBuffer = nullptr;
+		m_indexBuffer = nullptr;
+		m_transformUniformBuffer = nullptr;
+		m_barrierBuffer = nullptr;
+		m_descriptor = nullptr;
+		m_pipeline = nullptr;
+
+		if (m_frameFence != VK_NULL_HANDLE)
+		{
+			vkDestroyFence(m_vulkanSetup.device, m_frameFence, nullptr);
+			m_frameFence = VK_NULL_HANDLE;
+		}
+	}
+
+	std::unique_ptr<Buffer> m_vertexBuffer;
+	std::unique_ptr<Buffer> m_indexBuffer;
+	std::unique_ptr<Buffer> m_transformUniformBuffer;
+	std::unique_ptr<Buffer> m_barrierBuffer;
+
+	std::unique_ptr<GraphicPipeline> m_pipeline;
+	std::unique_ptr<DescriptorSet> m_descriptor;
+
+	// the first one holds the barriers, the rest the draws
+	std::vector<std::shared_ptr<CommandBuffer>> m_secondaryCommandBuffers;
+
+	VkFence m_frameFence = VK_NULL_HANDLE;
+};
+
+static std::unique_ptr<benchmarkContext> p_benchmark = nullptr;
+static void render(benchmarking& bench);
+
+int main(int argc, char** argv)
+{
+	p_benchmark = std::make_unique<benchmarkContext>();
+
+	vulkan_req_t req;
+	req.usage = show_usage;
+	req.cmdopt = test_cmdopt;
+	vulkan_setup_t vulkan = test_init(argc, argv, "vulkan_record_1", req);
+
+	p_benchmark->initBasic(vulkan, req);
+
+	auto vertShader = std::make_shared<Shader>(vulkan.device);
+	vertShader->create(vulkan_graphics_1_vert_spirv, vulkan_graphics_1_vert_spirv_len);
+
+	/******************************** buffers ***************************************/
+	auto vertexBuffer = std::make_unique<Buffer>(vulkan);
+	vertexBuffer->create(VK_BUFFER_USAGE_TRANSFER_DST_BIT|VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, sizeof(Vertex)*vertices.size(), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	p_benchmark->updateBuffer(vertices, *vertexBuffer);
+
+	auto indexBuffer = std::make_unique<Buffer>(vulkan);
+	indexBuffer->create(VK_BUFFER_USAGE_TRANSFER_DST_BIT|VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sizeof(uint16_t)*indices.size(), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	p_benchmark->updateBuffer(indices, *indexBuffer);
+
+	auto transformUniformBuffer = std::make_unique<Buffer>(vulkan);
+	transformUniformBuffer->create(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, (VkDeviceSize)sizeof(Transform), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	transformUniformBuffer->map();
+	memset(transformUniformBuffer->m_mappedAddress, 0, sizeof(Transform));
+	transformUniformBuffer->flush(true);
+
+	// only used as the target of the barriers
+	auto barrierBuffer = std::make_unique<Buffer>(vulkan);
+	barrierBuffer->create(VK_BUFFER_USAGE_TRANSFER_DST_BIT, 4096, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	p_benchmark->submitStaging(true, {}, {}, false);
+
+	/******************************* descriptor *************************************/
+	auto descSetLayout = std::make_shared<DescriptorSetLayout>(vulkan.device);
+	descSetLayout->insertBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT);
+	descSetLayout->create();
+
+	auto descSetPool = std::make_shared<DescriptorSetPool>(descSetLayout);
+	descSetPool->create(1);
+
+	auto descriptor = std::make_unique<DescriptorSet>(std::move(descSetPool));
+	descriptor->create();
+	descriptor->setBuffer(0, *transformUniformBuffer);
+	descriptor->update();
+
+	/**************************** graphic pipeline **********************************/
+	std::unordered_map<uint32_t, std::shared_ptr<DescriptorSetLayout>> layoutMap = { {0, descSetLayout} };
+	auto pipelineLayout = std::make_shared<PipelineLayout>(vulkan.device);
+	pipelineLayout->create(layoutMap, { {VK_SHADER_STAGE_VERTEX_BIT, 0, 16} });
+	layoutMap[0] = nullptr;
+	descSetLayout = nullptr;
+
+	GraphicPipelineState pipelineState;
+	pipelineState.setVertexBinding(0, *vertexBuffer, sizeof(Vertex));
+	pipelineState.setVertexAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos));
+	pipelineState.setVertexAttribute(1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color));
+	pipelineState.setVertexAttribute(2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, texCoord));
+	pipelineState.m_rasterizationState.rasterizerDiscardEnable = VK_TRUE;
+
+	SubpassInfo subpass{};
+	auto renderpass = std::make_unique<RenderPass>(vulkan.device);
+	renderpass->create({}, {subpass});
+
+	auto framebuffer = std::make_shared<FrameBuffer>(vulkan.device);
+	framebuffer->create(*renderpass, {p_benchmark->width, p_benchmark->height});
+
+	ShaderPipelineState vertShaderState(VK_SHADER_STAGE_VERTEX_BIT, std::move(vertShader));
+	auto pipeline = std::make_unique<GraphicPipeline>(std::move(pipelineLayout));
+	pipeline->create({vertShaderState}, pipelineState, *renderpass);
+
+	/************************ secondary command buffers *****************************/
+	if (secondaries > 0)
+	{
+		for (int i = 0; i < secondaries + 1; i++)
+		{
+			auto commandBuffer = std::make_shared<CommandBuffer>(p_benchmark->m_defaultCommandPool);
+			commandBuffer->create(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+			p_benchmark->m_secondaryCommandBuffers.push_back(commandBuffer);
+		}
+	}
+
+	/****************************** save all resources ******************************/
+	p_benchmark->m_vertexBuffer = std::move(vertexBuffer);
+	p_benchmark->m_indexBuffer = std::move(indexBuffer);
+	p_benchmark->m_transformUniformBuffer = std::move(transformUniformBuffer);
+	p_benchmark->m_barrierBuffer = std::move(barrierBuffer);
+	p_benchmark->m_descriptor = std::move(descriptor);
+	p_benchmark->m_pipeline = std::move(pipeline);
+	p_benchmark->m_renderPass = std::move(renderpass);
+	p_benchmark->m_framebuffer = std::move(framebuffer);
+
+	VkFenceCreateInfo fenceInfo { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	vkCreateFence(vulkan.device, &fenceInfo, nullptr, &p_benchmark->m_frameFence);
+
+	/********************************** rendering ***********************************/
+	render(p_benchmark->m_vulkanSetup.bench);
+
+	vkDeviceWaitIdle(vulkan.device);
+
+	vertShaderState.destroy();
+	p_benchmark = nullptr;
+
+	return 0;
+}
+
+// Record draws [first, first + count) into the command buffer, and return the number of commands recorded
+static uint64_t record_draws(CommandBuffer& commandBuffer, int first, int count)
+{
+	const VkCommandBuffer cmd = commandBuffer.getHandle();
+	const VkPipelineLayout layout = p_benchmark->m_pipeline->m_pipelineLayout->getHandle();
+	const VkBuffer vertexBuffer = p_benchmark->m_vertexBuffer->getHandle();
+	const VkDescriptorSet descriptor = p_benchmark->m_descriptor->getHandle();
+	const VkDeviceSize offset = 0;
+	uint64_t commands = 0;
+
+	for (int i = first; i < first + count; i++)
+	{
+		if (i == first || i % rebind_interval == 0) // state is not inherited by secondary command buffers
+		{
+			commandBuffer.bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, *p_benchmark->m_pipeline);
+			vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, &offset);
+			vkCmdBindIndexBuffer(cmd, p_benchmark->m_indexBuffer->getHandle(), 0, VK_INDEX_TYPE_UINT16);
+			vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &descriptor, 0, nullptr);
+			commands += 4;
+		}
+		const float constants[4] = { (float)i, 0.0f, 0.0f, 0.0f };
+		vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), constants);
+		if (i & 1) vkCmdDrawIndexed(cmd, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+		else vkCmdDraw(cmd, 3, 1, 0, 0);
+		commands += 2;
+	}
+	return commands;
+}
+
+static uint64_t record_barriers(CommandBuffer& commandBuffer, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		commandBuffer.bufferMemoryBarrier(*p_benchmark->m_barrierBuffer, 0, VK_WHOLE_SIZE,
+		                                  VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		                                  VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	}
+	return count;
+}
+
+// Record the whole frame, and return the number of commands recorded
+static uint64_t record_frame(VkCommandBufferUsageFlags flags)
+{
+	CommandBuffer& primary = *p_benchmark->m_defaultCommandBuffer;
+	const RenderPass& renderPass = *p_benchmark->m_renderPass;
+	const FrameBuffer& frameBuffer = *p_benchmark->m_framebuffer;
+	const int barriers = draws / barrier_interval;
+	uint64_t commands = 0;
+
+	if (secondaries == 0)
+	{
+		primary.begin(flags);
+		commands += record_barriers(primary, barriers);
+		primary.beginRenderPass(renderPass, frameBuffer);
+		commands += record_draws(primary, 0, draws);
+		primary.endRenderPass();
+		primary.end();
+		return commands + 2;
+	}
+
+	// barriers are not allowed inside the render pass, so they get their own secondary command buffer
+	std::vector<std::shared_ptr<CommandBuffer>>& secondary = p_benchmark->m_secondaryCommandBuffers;
+	secondary[0]->beginSecondary(nullptr, nullptr, flags);
+	commands += record_barriers(*secondary[0], barriers);
+	secondary[0]->end();
+
+	int first = 0;
+	for (int i = 0; i < secondaries; i++)
+	{
+		const int count = (draws - first) / (secondaries - i);
+		secondary[i + 1]->beginSecondary(&renderPass, &frameBuffer, flags);
+		commands += record_draws(*secondary[i + 1], first, count);
+		secondary[i + 1]->end();
+		first += count;
+	}
+
+	primary.begin(flags);
+	primary.executeCommands({ secondary[0] });
+	primary.beginRenderPass(renderPass, frameBuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	primary.executeCommands(std::vector<std::shared_ptr<CommandBuffer>>(secondary.begin() + 1, secondary.end()));
+	primary.endRenderPass();
+	primary.end();
+	return commands + 4;
+}
+
+static void render(benchmarking& bench)
+{
+	const VkDevice device = p_benchmark->m_vulkanSetup.device;
+	const int frames = p__loops;
+	// with simultaneous use we can resubmit without waiting for the previous submission to complete
+	const VkCommandBufferUsageFlags flags = reuse ? VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	uint64_t record_time = 0;
+	uint64_t submit_time = 0;
+	uint64_t commands = 0;
+	int recorded = 0;
+
+	if (reuse)
+	{
+		const uint64_t start = gettime();
+		commands = record_frame(flags);
+		record_time += gettime() - start;
+		recorded++;
+	}
+
+	for (int frame = 0; frame < frames; frame++)
+	{
+		bench_start_iteration(bench);
+		if (!reuse)
+		{
+			vkWaitForFences(device, 1, &p_benchmark->m_frameFence, VK_TRUE, UINT64_MAX);
+			vkResetFences(device, 1, &p_benchmark->m_frameFence);
+
+			const uint64_t start = gettime();
+			commands = record_frame(flags);
+			record_time += gettime() - start;
+			recorded++;
+		}
+
+		const uint64_t start = gettime();
+		p_benchmark->submit(p_benchmark->m_defaultQueue, { p_benchmark->m_defaultCommandBuffer }, reuse ? VK_NULL_HANDLE : p_benchmark->m_frameFence, {}, {}, false);
+		submit_time += gettime() - start;
+		bench_stop_iteration(bench);
+	}
+	vkQueueWaitIdle(p_benchmark->m_defaultQueue);
+
+	const double record_ns = (double)record_time / recorded;
+	printf("Recorded %lu commands per frame (%d draws, %d barriers) into %s, %s\n", (unsigned long)commands, draws, draws / barrier_interval,
+	       secondaries ? (std::to_string(secondaries) + " secondary command buffers").c_str() : "the primary command buffer",
+	       reuse ? "once and resubmitted every frame" : "re-recorded every frame");
+	printf("Recording: %.3f ms per frame, %.1f ns per command, %.0f commands/sec\n", record_ns / 1000000.0, record_ns / commands,
+	       commands * 1000000000.0 / record_ns);
+	printf("Submit: %.3f ms per frame over %d frames\n", (double)submit_time / frames / 1000000.0, frames);
+}
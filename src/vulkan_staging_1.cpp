@@ -0,0 +1,66 @@
+// Unit test for the staging ring of GraphicContext. Uploads back to back that do not fit before the end
+// of the ring while nothing else is outstanding must wrap around instead of waiting forever, and uploads
+// larger than the ring go through a dedicated staging buffer.
+
+#include "vulkan_common.h"
+#include "vulkan_graphics_common.h"
+
+using namespace tracetooltests;
+
+static void show_usage()
+{
+	usage();
+}
+
+// Upload a recognizable pattern of the given size, and return the destination buffer for checking
+static std::unique_ptr<Buffer> upload(const vulkan_setup_t& vulkan, GraphicContext& context, VkDeviceSize size, uint32_t seed, bool submitOnce)
+{
+	std::vector<uint32_t> data(size / sizeof(uint32_t));
+	for (unsigned i = 0; i < data.size(); i++) data[i] = seed * 0x9e3779b9u + i;
+
+	auto buffer = std::make_unique<Buffer>(vulkan);
+	buffer->create(VK_BUFFER_USAGE_TRANSFER_DST_BIT, size, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	context.updateBuffer(data, *buffer, 0, 0, submitOnce);
+	return buffer;
+}
+
+static void verify(VkDeviceSize size, uint32_t seed, Buffer& buffer)
+{
+	buffer.map();
+	const uint32_t* data = (const uint32_t*)buffer.m_mappedAddress;
+	for (unsigned i = 0; i < size / sizeof(uint32_t); i++) assert(data[i] == seed * 0x9e3779b9u + i);
+	buffer.unmap();
+}
+
+int main(int argc, char** argv)
+{
+	vulkan_req_t req;
+	req.usage = show_usage;
+	vulkan_setup_t vulkan = test_init(argc, argv, "vulkan_staging_1", req);
+
+	auto context = std::make_unique<GraphicContext>();
+	context->initBasic(vulkan, req);
+
+	// with the default 16 MB ring: 9 MB, then 10 MB which only fits after wrapping around, then 9 MB
+	// again which fits neither before nor after the head, and finally one bigger than the whole ring
+	const VkDeviceSize ring = context->m_stagingRingSize;
+	const std::vector<VkDeviceSize> sizes = { ring / 16 * 9, ring / 16 * 10, ring / 16 * 9, ring + ring / 4 };
+
+	// submit and wait for every upload on its own, so the ring is empty before each of them
+	for (unsigned i = 0; i < sizes.size(); i++)
+	{
+		std::unique_ptr<Buffer> buffer = upload(vulkan, *context, sizes[i], i, true);
+		verify(sizes[i], i, *buffer);
+	}
+
+	// record all uploads into one batch, so the ring fills up with uploads that are not submitted yet
+	std::vector<std::unique_ptr<Buffer>> buffers;
+	for (unsigned i = 0; i < sizes.size(); i++) buffers.push_back(upload(vulkan, *context, sizes[i], 100 + i, false));
+	context->submitStaging(true, {}, {}, false);
+	for (unsigned i = 0; i < sizes.size(); i++) verify(sizes[i], 100 + i, *buffers[i]);
+
+	buffers.clear();
+	context = nullptr;
+
+	return 0;
+}
@@ -1,9 +1,382 @@
+// API call overhead micro-benchmarks. Each case calls one entry point (or a create/destroy
+// pair) in a tight loop, so that per-call tracer overhead can be compared against a run
+// without any layers.
+
 #include "vulkan_common.h"
 #include <inttypes.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 static vulkan_req_t reqs;
 static int loops = 250000;
 static int variant = 1;
+static int batch = 1000;
+static int threads = 1;
+
+// Smallest valid vertex shader, which just writes a constant position. The pipeline discards
+// rasterization, so no fragment shader or attachments are needed to have something to draw with.
+// Assembled by hand, since it is so short:
+//   OpCapability Shader
+//   OpMemoryModel Logical GLSL450
+//   OpEntryPoint Vertex %1 "main" %2
+//   OpDecorate %2 BuiltIn Position
+//   %3 = OpTypeVoid
+//   %4 = OpTypeFunction %3
+//   %5 = OpTypeFloat 32
+//   %6 = OpTypeVector %5 4
+//   %7 = OpTypePointer Output %6
+//   %2 = OpVariable %7 Output
+//   %8 = OpConstant %5 0
+//   %9 = OpConstantComposite %6 %8 %8 %8 %8
+//   %1 = OpFunction %3 None %4
+//  %10 = OpLabel
+//        OpStore %2 %9
+//        OpReturn
+//        OpFunctionEnd
+static const uint32_t vertex_spirv[] = {
+	0x07230203, 0x00010000, 0, 11, 0,
+	(2 << 16) | 17, 1,
+	(3 << 16) | 14, 0, 1,
+	(6 << 16) | 15, 0, 1, 0x6e69616d, 0, 2,
+	(4 << 16) | 71, 2, 11, 0,
+	(2 << 16) | 19, 3,
+	(3 << 16) | 33, 4, 3,
+	(3 << 16) | 22, 5, 32,
+	(4 << 16) | 23, 6, 5, 4,
+	(4 << 16) | 32, 7, 3, 6,
+	(4 << 16) | 59, 7, 2, 3,
+	(4 << 16) | 43, 5, 8, 0,
+	(7 << 16) | 44, 6, 9, 8, 8, 8, 8,
+	(5 << 16) | 54, 3, 1, 0, 4,
+	(2 << 16) | 248, 10,
+	(3 << 16) | 62, 2, 9,
+	(1 << 16) | 253,
+	(1 << 16) | 56,
+};
+
+/// Objects that are never changed after creation, so all cases can share them
+struct stress_shared
+{
+	VkShaderModule shader = VK_NULL_HANDLE;
+	VkRenderPass renderpass = VK_NULL_HANDLE;
+	VkFramebuffer framebuffer = VK_NULL_HANDLE;
+	VkDescriptorSetLayout set_layout = VK_NULL_HANDLE;
+	VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	uint32_t memory_type = 0;
+};
+
+/// Objects that the API requires external synchronization for
+struct stress_objects
+{
+	VkQueue queue = VK_NULL_HANDLE;
+	VkCommandPool pool = VK_NULL_HANDLE;
+	VkCommandBuffer cmd = VK_NULL_HANDLE;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceMemory mapped_memory = VK_NULL_HANDLE; // kept mapped for the flush and invalidate cases
+	VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	VkFence fence = VK_NULL_HANDLE;
+	VkEvent event = VK_NULL_HANDLE;
+};
+
+static const VkDeviceSize buffer_size = 64 * 1024;
+
+/// What state the command buffer must be in before running a case
+enum stress_state
+{
+	STATE_NONE, // not used
+	STATE_RECORDING, // begun, outside any render pass
+	STATE_RENDERPASS, // begun, inside a render pass with pipeline, descriptor set, vertex and index buffers bound
+};
+
+typedef void (*STRESS_CASE_RUN)(const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count);
+
+struct stress_case
+{
+	const char* name;
+	stress_state state;
+	STRESS_CASE_RUN run;
+};
+
+static const stress_case cases[] =
+{
+	{ "vkEnumeratePhysicalDeviceGroups", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++)
+		{
+			uint32_t devgrpcount = 0;
+			VkResult r = vkEnumeratePhysicalDeviceGroups(vulkan.instance, &devgrpcount, nullptr);
+			check(r);
+		}
+	} },
+	{ "vkGetFenceStatus", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++) vkGetFenceStatus(vulkan.device, o.fence);
+	} },
+	{ "vkGetPhysicalDeviceProperties", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkPhysicalDeviceProperties properties;
+		for (int i = 0; i < count; i++) vkGetPhysicalDeviceProperties(vulkan.physical, &properties);
+	} },
+	{ "vkGetPhysicalDeviceFormatProperties", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkFormatProperties properties;
+		for (int i = 0; i < count; i++) vkGetPhysicalDeviceFormatProperties(vulkan.physical, VK_FORMAT_R8G8B8A8_UNORM, &properties);
+	} },
+	{ "vkGetPhysicalDeviceMemoryProperties", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkPhysicalDeviceMemoryProperties properties;
+		for (int i = 0; i < count; i++) vkGetPhysicalDeviceMemoryProperties(vulkan.physical, &properties);
+	} },
+	{ "vkGetDeviceQueue", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkQueue queue;
+		for (int i = 0; i < count; i++) vkGetDeviceQueue(vulkan.device, 0, 0, &queue);
+	} },
+	{ "vkGetDeviceProcAddr", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++) (void)vkGetDeviceProcAddr(vulkan.device, "vkCmdDraw");
+	} },
+	{ "vkGetBufferMemoryRequirements", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkMemoryRequirements req;
+		for (int i = 0; i < count; i++) vkGetBufferMemoryRequirements(vulkan.device, o.buffer, &req);
+	} },
+	{ "vkGetEventStatus", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++) vkGetEventStatus(vulkan.device, o.event);
+	} },
+	{ "vkSetEvent + vkResetEvent", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++)
+		{
+			vkSetEvent(vulkan.device, o.event);
+			vkResetEvent(vulkan.device, o.event);
+		}
+	} },
+	{ "vkCreateBuffer + vkDestroyBuffer", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkBufferCreateInfo info = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, nullptr };
+		info.size = 1024;
+		info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+		info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		for (int i = 0; i < count; i++)
+		{
+			VkBuffer buffer;
+			VkResult r = vkCreateBuffer(vulkan.device, &info, nullptr, &buffer);
+			check(r);
+			vkDestroyBuffer(vulkan.device, buffer, nullptr);
+		}
+	} },
+	{ "vkCreateImage + vkDestroyImage", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkImageCreateInfo info = { VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO, nullptr };
+		info.imageType = VK_IMAGE_TYPE_2D;
+		info.format = VK_FORMAT_R8G8B8A8_UNORM;
+		info.extent = { 64, 64, 1 };
+		info.mipLevels = 1;
+		info.arrayLayers = 1;
+		info.samples = VK_SAMPLE_COUNT_1_BIT;
+		info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		info.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+		info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		for (int i = 0; i < count; i++)
+		{
+			VkImage image;
+			VkResult r = vkCreateImage(vulkan.device, &info, nullptr, &image);
+			check(r);
+			vkDestroyImage(vulkan.device, image, nullptr);
+		}
+	} },
+	{ "vkCreateFence + vkDestroyFence", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkFenceCreateInfo info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
+		for (int i = 0; i < count; i++)
+		{
+			VkFence fence;
+			VkResult r = vkCreateFence(vulkan.device, &info, nullptr, &fence);
+			check(r);
+			vkDestroyFence(vulkan.device, fence, nullptr);
+		}
+	} },
+	{ "vkCreateSemaphore + vkDestroySemaphore", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkSemaphoreCreateInfo info = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, nullptr };
+		for (int i = 0; i < count; i++)
+		{
+			VkSemaphore semaphore;
+			VkResult r = vkCreateSemaphore(vulkan.device, &info, nullptr, &semaphore);
+			check(r);
+			vkDestroySemaphore(vulkan.device, semaphore, nullptr);
+		}
+	} },
+	{ "vkCreateSampler + vkDestroySampler", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkSamplerCreateInfo info = { VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO, nullptr };
+		info.magFilter = VK_FILTER_LINEAR;
+		info.minFilter = VK_FILTER_LINEAR;
+		info.maxLod = 1.0f;
+		for (int i = 0; i < count; i++)
+		{
+			VkSampler sampler;
+			VkResult r = vkCreateSampler(vulkan.device, &info, nullptr, &sampler);
+			check(r);
+			vkDestroySampler(vulkan.device, sampler, nullptr);
+		}
+	} },
+	{ "vkCreateEvent + vkDestroyEvent", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkEventCreateInfo info = { VK_STRUCTURE_TYPE_EVENT_CREATE_INFO, nullptr };
+		for (int i = 0; i < count; i++)
+		{
+			VkEvent event;
+			VkResult r = vkCreateEvent(vulkan.device, &info, nullptr, &event);
+			check(r);
+			vkDestroyEvent(vulkan.device, event, nullptr);
+		}
+	} },
+	{ "vkAllocateMemory + vkFreeMemory", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkMemoryAllocateInfo info = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr };
+		info.allocationSize = 4096;
+		info.memoryTypeIndex = s.memory_type;
+		for (int i = 0; i < count; i++)
+		{
+			VkDeviceMemory memory;
+			VkResult r = vkAllocateMemory(vulkan.device, &info, nullptr, &memory);
+			check(r);
+			vkFreeMemory(vulkan.device, memory, nullptr);
+		}
+	} },
+	{ "vkAllocateCommandBuffers + vkFreeCommandBuffers", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkCommandBufferAllocateInfo info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr };
+		info.commandPool = o.pool;
+		info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		info.commandBufferCount = 1;
+		for (int i = 0; i < count; i++)
+		{
+			VkCommandBuffer cmd;
+			VkResult r = vkAllocateCommandBuffers(vulkan.device, &info, &cmd);
+			check(r);
+			vkFreeCommandBuffers(vulkan.device, o.pool, 1, &cmd);
+		}
+	} },
+	{ "vkAllocateDescriptorSets + vkFreeDescriptorSets", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkDescriptorSetAllocateInfo info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, nullptr };
+		info.descriptorPool = o.descriptor_pool;
+		info.descriptorSetCount = 1;
+		info.pSetLayouts = &s.set_layout;
+		for (int i = 0; i < count; i++)
+		{
+			VkDescriptorSet set;
+			VkResult r = vkAllocateDescriptorSets(vulkan.device, &info, &set);
+			check(r);
+			vkFreeDescriptorSets(vulkan.device, o.descriptor_pool, 1, &set);
+		}
+	} },
+	{ "vkMapMemory + vkUnmapMemory", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++)
+		{
+			void* ptr = nullptr;
+			VkResult r = vkMapMemory(vulkan.device, o.memory, 0, VK_WHOLE_SIZE, 0, &ptr);
+			check(r);
+			vkUnmapMemory(vulkan.device, o.memory);
+		}
+	} },
+	{ "vkFlushMappedMemoryRanges", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkMappedMemoryRange range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, o.mapped_memory, 0, VK_WHOLE_SIZE };
+		for (int i = 0; i < count; i++) vkFlushMappedMemoryRanges(vulkan.device, 1, &range);
+	} },
+	{ "vkInvalidateMappedMemoryRanges", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkMappedMemoryRange range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, o.mapped_memory, 0, VK_WHOLE_SIZE };
+		for (int i = 0; i < count; i++) vkInvalidateMappedMemoryRanges(vulkan.device, 1, &range);
+	} },
+	{ "vkUpdateDescriptorSets", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkDescriptorBufferInfo bufferinfo = { o.buffer, 0, 256 };
+		VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+		write.dstSet = o.set;
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		write.pBufferInfo = &bufferinfo;
+		for (int i = 0; i < count; i++) vkUpdateDescriptorSets(vulkan.device, 1, &write, 0, nullptr);
+	} },
+	{ "vkBeginCommandBuffer + vkEndCommandBuffer", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkCommandBufferBeginInfo info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr };
+		for (int i = 0; i < count; i++)
+		{
+			vkBeginCommandBuffer(o.cmd, &info);
+			vkEndCommandBuffer(o.cmd);
+		}
+	} },
+	{ "vkQueueSubmit with an empty batch", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkSubmitInfo info = { VK_STRUCTURE_TYPE_SUBMIT_INFO, nullptr };
+		for (int i = 0; i < count; i++)
+		{
+			VkResult r = vkQueueSubmit(o.queue, 1, &info, VK_NULL_HANDLE);
+			check(r);
+		}
+	} },
+	{ "vkQueueSubmit with an empty batch + vkWaitForFences + vkResetFences", STATE_NONE, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkSubmitInfo info = { VK_STRUCTURE_TYPE_SUBMIT_INFO, nullptr };
+		for (int i = 0; i < count; i++)
+		{
+			VkResult r = vkQueueSubmit(o.queue, 1, &info, o.fence);
+			check(r);
+			r = vkWaitForFences(vulkan.device, 1, &o.fence, VK_TRUE, UINT64_MAX);
+			check(r);
+			vkResetFences(vulkan.device, 1, &o.fence);
+		}
+	} },
+	{ "vkCmdBindPipeline", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++) vkCmdBindPipeline(o.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, s.pipeline);
+	} },
+	{ "vkCmdBindDescriptorSets", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++) vkCmdBindDescriptorSets(o.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, s.pipeline_layout, 0, 1, &o.set, 0, nullptr);
+	} },
+	{ "vkCmdPushConstants", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		const float values[4] = { 1.0f, 2.0f, 3.0f, 4.0f };
+		for (int i = 0; i < count; i++) vkCmdPushConstants(o.cmd, s.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(values), values);
+	} },
+	{ "vkCmdBindVertexBuffers", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		const VkDeviceSize offset = 0;
+		for (int i = 0; i < count; i++) vkCmdBindVertexBuffers(o.cmd, 0, 1, &o.buffer, &offset);
+	} },
+	{ "vkCmdBindIndexBuffer", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++) vkCmdBindIndexBuffer(o.cmd, o.buffer, 0, VK_INDEX_TYPE_UINT16);
+	} },
+	{ "vkCmdSetViewport", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		const VkViewport viewport = { 0.0f, 0.0f, 64.0f, 64.0f, 0.0f, 1.0f };
+		for (int i = 0; i < count; i++) vkCmdSetViewport(o.cmd, 0, 1, &viewport);
+	} },
+	{ "vkCmdSetScissor", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		const VkRect2D scissor = { { 0, 0 }, { 64, 64 } };
+		for (int i = 0; i < count; i++) vkCmdSetScissor(o.cmd, 0, 1, &scissor);
+	} },
+	{ "vkCmdPipelineBarrier", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT };
+		for (int i = 0; i < count; i++) vkCmdPipelineBarrier(o.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	} },
+	{ "vkCmdCopyBuffer", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		const VkBufferCopy region = { 0, buffer_size / 2, 256 };
+		for (int i = 0; i < count; i++) vkCmdCopyBuffer(o.cmd, o.buffer, o.buffer, 1, &region);
+	} },
+	{ "vkCmdFillBuffer", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++) vkCmdFillBuffer(o.cmd, o.buffer, 0, 256, 0x12345678);
+	} },
+	{ "vkCmdUpdateBuffer", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		const uint32_t data[4] = { 1, 2, 3, 4 };
+		for (int i = 0; i < count; i++) vkCmdUpdateBuffer(o.cmd, o.buffer, 0, sizeof(data), data);
+	} },
+	{ "vkCmdBeginRenderPass + vkCmdEndRenderPass", STATE_RECORDING, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		VkRenderPassBeginInfo info = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO, nullptr, s.renderpass, s.framebuffer, { { 0, 0 }, { 1, 1 } }, 0, nullptr };
+		for (int i = 0; i < count; i++)
+		{
+			vkCmdBeginRenderPass(o.cmd, &info, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdEndRenderPass(o.cmd);
+		}
+	} },
+	{ "vkCmdDraw", STATE_RENDERPASS, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++) vkCmdDraw(o.cmd, 3, 1, 0, 0);
+	} },
+	{ "vkCmdDrawIndexed", STATE_RENDERPASS, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++) vkCmdDrawIndexed(o.cmd, 3, 1, 0, 0, 0);
+	} },
+	{ "vkCmdDrawIndirect", STATE_RENDERPASS, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++) vkCmdDrawIndirect(o.cmd, o.buffer, 0, 1, sizeof(VkDrawIndirectCommand));
+	} },
+	{ "vkCmdDrawIndexedIndirect", STATE_RENDERPASS, [](const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, int count) {
+		for (int i = 0; i < count; i++) vkCmdDrawIndexedIndirect(o.cmd, o.buffer, 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+	} },
+};
+static const int case_count = sizeof(cases) / sizeof(cases[0]);
 
 static inline uint64_t mygettime()
 {
@@ -14,10 +387,11 @@ static inline uint64_t mygettime()
 
 static void show_usage()
 {
-	printf("-c/--case N            Choose test case (default %d)\n", variant);
-	printf("\t1 - vkEnumeratePhysicalDeviceGroups\n");
-	printf("\t2 - vkGetFenceStatus\n");
+	printf("-c/--case N            Choose test case, or 0 for all of them (default %d)\n", variant);
+	for (int i = 0; i < case_count; i++) printf("\t%d - %s\n", i + 1, cases[i].name);
 	printf("-l/--loops N           Number of loops to run (default %d)\n", loops);
+	printf("-b/--batch N           Number of calls timed together as one iteration (default %d)\n", batch);
+	printf("-T/--threads N         Also run each case on N threads at once, and compare with the single thread run (default %d)\n", threads);
 }
 
 static bool test_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
@@ -25,6 +399,7 @@ static bool test_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
 	if (match(argv[i], "-c", "--case"))
 	{
 		variant = get_arg(argv, ++i, argc);
+		if (variant < 0 || variant > case_count) ABORT("No test case %d", variant);
 		return true;
 	}
 	else if (match(argv[i], "-l", "--loops"))
@@ -32,41 +407,263 @@ static bool test_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
 		loops = get_arg(argv, ++i, argc);
 		return true;
 	}
+	else if (match(argv[i], "-b", "--batch"))
+	{
+		batch = std::max(get_arg(argv, ++i, argc), 1);
+		return true;
+	}
+	else if (match(argv[i], "-T", "--threads"))
+	{
+		threads = get_arg(argv, ++i, argc);
+		if (threads < 1 || threads > 256) ABORT("Bad number of threads %d", threads);
+		reqs.queues = threads; // one queue per thread for the submit cases, if there are enough
+		reqs.fewer_queues_ok = true;
+		return true;
+	}
 	return false;
 }
 
-static const char* case_1(vulkan_setup_t& vulkan, bool active)
+static void create_shared(const vulkan_setup_t& vulkan, stress_shared& s)
+{
+	VkShaderModuleCreateInfo shaderinfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, nullptr, 0, sizeof(vertex_spirv), vertex_spirv };
+	VkResult result = vkCreateShaderModule(vulkan.device, &shaderinfo, nullptr, &s.shader);
+	check(result);
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	VkRenderPassCreateInfo renderpassinfo = { VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO, nullptr };
+	renderpassinfo.subpassCount = 1;
+	renderpassinfo.pSubpasses = &subpass;
+	result = vkCreateRenderPass(vulkan.device, &renderpassinfo, nullptr, &s.renderpass);
+	check(result);
+
+	VkFramebufferCreateInfo framebufferinfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO, nullptr };
+	framebufferinfo.renderPass = s.renderpass;
+	framebufferinfo.width = 1;
+	framebufferinfo.height = 1;
+	framebufferinfo.layers = 1;
+	result = vkCreateFramebuffer(vulkan.device, &framebufferinfo, nullptr, &s.framebuffer);
+	check(result);
+
+	VkDescriptorSetLayoutBinding binding = { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr };
+	VkDescriptorSetLayoutCreateInfo layoutinfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr, 0, 1, &binding };
+	result = vkCreateDescriptorSetLayout(vulkan.device, &layoutinfo, nullptr, &s.set_layout);
+	check(result);
+
+	VkPushConstantRange pushrange = { VK_SHADER_STAGE_VERTEX_BIT, 0, 16 };
+	VkPipelineLayoutCreateInfo pipelinelayoutinfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, nullptr };
+	pipelinelayoutinfo.setLayoutCount = 1;
+	pipelinelayoutinfo.pSetLayouts = &s.set_layout;
+	pipelinelayoutinfo.pushConstantRangeCount = 1;
+	pipelinelayoutinfo.pPushConstantRanges = &pushrange;
+	result = vkCreatePipelineLayout(vulkan.device, &pipelinelayoutinfo, nullptr, &s.pipeline_layout);
+	check(result);
+
+	VkPipelineShaderStageCreateInfo stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr };
+	stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stage.module = s.shader;
+	stage.pName = "main";
+	VkPipelineVertexInputStateCreateInfo vertexinput = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO, nullptr };
+	VkPipelineInputAssemblyStateCreateInfo inputassembly = { VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO, nullptr };
+	inputassembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	VkPipelineRasterizationStateCreateInfo rasterization = { VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO, nullptr };
+	rasterization.rasterizerDiscardEnable = VK_TRUE; // so no viewport, multisample or blend state needed
+	rasterization.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterization.lineWidth = 1.0f;
+	VkGraphicsPipelineCreateInfo pipelineinfo = { VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO, nullptr };
+	pipelineinfo.stageCount = 1;
+	pipelineinfo.pStages = &stage;
+	pipelineinfo.pVertexInputState = &vertexinput;
+	pipelineinfo.pInputAssemblyState = &inputassembly;
+	pipelineinfo.pRasterizationState = &rasterization;
+	pipelineinfo.layout = s.pipeline_layout;
+	pipelineinfo.renderPass = s.renderpass;
+	pipelineinfo.subpass = 0;
+	result = vkCreateGraphicsPipelines(vulkan.device, VK_NULL_HANDLE, 1, &pipelineinfo, nullptr, &s.pipeline);
+	check(result);
+}
+
+static void destroy_shared(const vulkan_setup_t& vulkan, stress_shared& s)
+{
+	vkDestroyPipeline(vulkan.device, s.pipeline, nullptr);
+	vkDestroyPipelineLayout(vulkan.device, s.pipeline_layout, nullptr);
+	vkDestroyDescriptorSetLayout(vulkan.device, s.set_layout, nullptr);
+	vkDestroyFramebuffer(vulkan.device, s.framebuffer, nullptr);
+	vkDestroyRenderPass(vulkan.device, s.renderpass, nullptr);
+	vkDestroyShaderModule(vulkan.device, s.shader, nullptr);
+}
+
+static void create_objects(const vulkan_setup_t& vulkan, stress_shared& s, stress_objects& o, uint32_t queue_index)
 {
-	VkResult r;
-	bench_start_scene(vulkan.bench, "case 1 : vkEnumeratePhysicalDeviceGroups");
-	if (active) bench_start_iteration(vulkan.bench);
-	for (int i = 0; i < loops; i++)
+	vkGetDeviceQueue(vulkan.device, 0, queue_index, &o.queue);
+
+	VkCommandPoolCreateInfo poolinfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr };
+	poolinfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolinfo.queueFamilyIndex = 0;
+	VkResult result = vkCreateCommandPool(vulkan.device, &poolinfo, nullptr, &o.pool);
+	check(result);
+	VkCommandBufferAllocateInfo cmdinfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr, o.pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1 };
+	result = vkAllocateCommandBuffers(vulkan.device, &cmdinfo, &o.cmd);
+	check(result);
+
+	VkBufferCreateInfo bufferinfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, nullptr };
+	bufferinfo.size = buffer_size;
+	bufferinfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+	                   | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferinfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	result = vkCreateBuffer(vulkan.device, &bufferinfo, nullptr, &o.buffer);
+	check(result);
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(vulkan.device, o.buffer, &req);
+	s.memory_type = get_device_memory_type(req.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	VkMemoryAllocateInfo allocinfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, req.size, s.memory_type };
+	result = vkAllocateMemory(vulkan.device, &allocinfo, nullptr, &o.memory);
+	check(result);
+	result = vkBindBufferMemory(vulkan.device, o.buffer, o.memory, 0);
+	check(result);
+	result = vkAllocateMemory(vulkan.device, &allocinfo, nullptr, &o.mapped_memory);
+	check(result);
+	void* ptr = nullptr;
+	result = vkMapMemory(vulkan.device, o.mapped_memory, 0, VK_WHOLE_SIZE, 0, &ptr);
+	check(result);
+
+	VkDescriptorPoolSize poolsize = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 };
+	VkDescriptorPoolCreateInfo descpoolinfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, nullptr };
+	descpoolinfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	descpoolinfo.maxSets = 2; // one for the alloc + free case
+	descpoolinfo.poolSizeCount = 1;
+	descpoolinfo.pPoolSizes = &poolsize;
+	result = vkCreateDescriptorPool(vulkan.device, &descpoolinfo, nullptr, &o.descriptor_pool);
+	check(result);
+	VkDescriptorSetAllocateInfo setinfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, nullptr, o.descriptor_pool, 1, &s.set_layout };
+	result = vkAllocateDescriptorSets(vulkan.device, &setinfo, &o.set);
+	check(result);
+	VkDescriptorBufferInfo descbufferinfo = { o.buffer, 0, 256 };
+	VkWriteDescriptorSet write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr };
+	write.dstSet = o.set;
+	write.descriptorCount = 1;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	write.pBufferInfo = &descbufferinfo;
+	vkUpdateDescriptorSets(vulkan.device, 1, &write, 0, nullptr);
+
+	VkFenceCreateInfo fenceinfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
+	result = vkCreateFence(vulkan.device, &fenceinfo, nullptr, &o.fence);
+	check(result);
+	VkEventCreateInfo eventinfo = { VK_STRUCTURE_TYPE_EVENT_CREATE_INFO, nullptr };
+	result = vkCreateEvent(vulkan.device, &eventinfo, nullptr, &o.event);
+	check(result);
+}
+
+static void destroy_objects(const vulkan_setup_t& vulkan, stress_objects& o)
+{
+	vkQueueWaitIdle(o.queue);
+	vkDestroyEvent(vulkan.device, o.event, nullptr);
+	vkDestroyFence(vulkan.device, o.fence, nullptr);
+	vkDestroyDescriptorPool(vulkan.device, o.descriptor_pool, nullptr);
+	vkUnmapMemory(vulkan.device, o.mapped_memory);
+	vkFreeMemory(vulkan.device, o.mapped_memory, nullptr);
+	vkDestroyBuffer(vulkan.device, o.buffer, nullptr);
+	vkFreeMemory(vulkan.device, o.memory, nullptr);
+	vkFreeCommandBuffers(vulkan.device, o.pool, 1, &o.cmd);
+	vkDestroyCommandPool(vulkan.device, o.pool, nullptr);
+}
+
+// Put the command buffer into the state the case needs, outside of the timed part
+static void begin_state(const stress_shared& s, stress_objects& o, stress_state state)
+{
+	if (state == STATE_NONE) return;
+	VkCommandBufferBeginInfo info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr };
+	VkResult result = vkBeginCommandBuffer(o.cmd, &info); // implicitly resets it, so it never grows beyond one batch
+	check(result);
+	if (state != STATE_RENDERPASS) return;
+	VkRenderPassBeginInfo rpinfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO, nullptr, s.renderpass, s.framebuffer, { { 0, 0 }, { 1, 1 } }, 0, nullptr };
+	vkCmdBeginRenderPass(o.cmd, &rpinfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindPipeline(o.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, s.pipeline);
+	vkCmdBindDescriptorSets(o.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, s.pipeline_layout, 0, 1, &o.set, 0, nullptr);
+	const VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(o.cmd, 0, 1, &o.buffer, &offset);
+	vkCmdBindIndexBuffer(o.cmd, o.buffer, 0, VK_INDEX_TYPE_UINT16);
+}
+
+static bool is_submit_case(const stress_case& c)
+{
+	return strncmp(c.name, "vkQueueSubmit", strlen("vkQueueSubmit")) == 0;
+}
+
+static void end_state(stress_objects& o, const stress_case& c)
+{
+	if (c.state == STATE_RENDERPASS) vkCmdEndRenderPass(o.cmd);
+	if (c.state != STATE_NONE)
+	{
+		VkResult result = vkEndCommandBuffer(o.cmd);
+		check(result);
+	}
+	if (is_submit_case(c)) vkQueueWaitIdle(o.queue);
+}
+
+/// Run 'count' calls of a case in batches, and return the time spent in the calls
+static uint64_t run_case(const vulkan_setup_t& vulkan, const stress_shared& s, stress_objects& o, const stress_case& c, int count, bench_recorder* recorder)
+{
+	uint64_t total = 0;
+	for (int done = 0; done < count; done += batch)
 	{
-		uint32_t devgrpcount = 0;
-		r = vkEnumeratePhysicalDeviceGroups(vulkan.instance, &devgrpcount, nullptr);
-		check(r);
+		const int n = std::min(batch, count - done);
+		begin_state(s, o, c.state);
+		const uint64_t start = gettime();
+		if (recorder) bench_start_iteration(*recorder);
+		c.run(vulkan, s, o, n);
+		if (recorder) bench_stop_iteration(*recorder);
+		total += gettime() - start;
+		end_state(o, c);
 	}
-	if (active) bench_stop_iteration(vulkan.bench);
-	return "vkEnumeratePhysicalDeviceGroups";
+	return total;
 }
 
-static const char* case_2(vulkan_setup_t& vulkan, bool active)
-{
-	VkResult r;
-	VkFence fence;
-	VkFenceCreateInfo fence_create_info = {};
-	fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	r = vkCreateFence(vulkan.device, &fence_create_info, NULL, &fence);
-	check(r);
-	bench_start_scene(vulkan.bench, "case 2 : vkGetFenceStatus");
-	if (active) bench_start_iteration(vulkan.bench);
-	for (int i = 0; i < loops; i++)
+/// Run a case on all threads at once, each with its own objects, and report per-thread and aggregate throughput
+static void run_threaded(vulkan_setup_t& vulkan, const stress_shared& s, std::vector<stress_objects>& objects, std::vector<bench_recorder*>& recorders,
+                         const stress_case& c, double single_calls_per_sec)
+{
+	for (bench_recorder* r : recorders) bench_thread_scene(vulkan.bench, *r);
+	std::mutex mutex;
+	std::condition_variable cv;
+	int ready = 0;
+	bool go = false;
+	std::vector<uint64_t> elapsed(threads, 0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++)
+	{
+		workers.emplace_back([&, t]() {
+			set_thread_name("stress thread");
+			run_case(vulkan, s, objects[t], c, std::min(loops, batch), nullptr); // warmup
+			{
+				// start all threads at the same time
+				std::unique_lock<std::mutex> lock(mutex);
+				ready++;
+				cv.notify_all();
+				cv.wait(lock, [&] { return go; });
+			}
+			elapsed[t] = run_case(vulkan, s, objects[t], c, loops, recorders[t]);
+		});
+	}
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [&] { return ready == threads; });
+		go = true;
+	}
+	cv.notify_all();
+	for (std::thread& w : workers) w.join();
+
+	// like the baseline, only count the time spent in the calls themselves
+	uint64_t total = 0;
+	for (int t = 0; t < threads; t++)
 	{
-		r = vkGetFenceStatus(vulkan.device, fence);
+		const double ns_per_call = (double)elapsed[t] / loops;
+		printf("\tthread %d: %.1f ns/call, %.0f calls/sec\n", t, ns_per_call, 1000000000.0 / ns_per_call);
+		total += elapsed[t];
 	}
-	if (active) bench_stop_iteration(vulkan.bench);
-	vkDestroyFence(vulkan.device, fence, nullptr);
-	return "vkGetFenceStatus";
+	const double aggregate = (double)loops * threads * 1000000000.0 / ((double)total / threads);
+	printf("\t%d threads: %.0f calls/sec aggregate, %.2fx the single thread rate, %.1f%% scaling efficiency\n", threads, aggregate,
+	       aggregate / single_calls_per_sec, 100.0 * aggregate / (single_calls_per_sec * threads));
 }
 
 int main(int argc, char** argv)
@@ -75,26 +672,55 @@ int main(int argc, char** argv)
 	reqs.cmdopt = test_cmdopt;
 	vulkan_setup_t vulkan = test_init(argc, argv, "vulkan_stress_1", reqs);
 
-	// warmup
-	switch (variant)
-	{
-	case 1: case_1(vulkan, false); break;
-	case 2: case_2(vulkan, false); break;
-	default: assert(false);
-	}
+	stress_shared shared;
+	create_shared(vulkan, shared);
+	// reqs.queues now holds the number of queues we actually got
+	const bool own_queues = (int)reqs.queues >= threads;
+	if (threads > 1 && !own_queues) printf("Only %u queues for %d threads, so submit cases are not run threaded\n", reqs.queues, threads);
+	std::vector<stress_objects> objects(threads);
+	for (int t = 0; t < threads; t++) create_objects(vulkan, shared, objects[t], own_queues ? t : 0);
+
+	// one sample per batch, the main thread records every single thread run
+	const int batches = (loops + batch - 1) / batch;
+	const int cases_run = (variant == 0) ? case_count : 1;
+	bench_reserve(vulkan.bench, (size_t)cases_run * batches);
+	// while each worker only needs room for one case at a time, and is reused for all of them
+	std::vector<bench_recorder*> recorders;
+	for (int t = 0; t < threads && threads > 1; t++) recorders.push_back(&bench_thread_recorder(vulkan.bench, batches));
 
-	// measurement
-	const char* name = "no such test case";
-	uint64_t before = mygettime();
-	switch (variant)
+	for (int i = 0; i < case_count; i++)
 	{
-	case 1: name = case_1(vulkan, true); break;
-	case 2: name = case_2(vulkan, true); break;
-	default: assert(false);
+		if (variant != 0 && variant != i + 1) continue;
+		const stress_case& c = cases[i];
+		const std::string scene = "case " + std::to_string(i + 1) + " : " + c.name;
+
+		run_case(vulkan, shared, objects[0], c, std::min(loops, batch), nullptr); // warmup
+
+		// single thread run, which is also the baseline for the threaded run
+		bench_start_scene(vulkan.bench, scene);
+		const uint64_t before = mygettime();
+		const uint64_t elapsed = run_case(vulkan, shared, objects[0], c, loops, &vulkan.bench.recorder);
+		const uint64_t after = mygettime();
+		bench_stop_scene(vulkan.bench);
+
+		const double ns_per_call = (double)elapsed / loops;
+		printf("Test case %d - %s, %d iterations: %.1f ns/call, %.0f calls/sec (%lu ns CPU time)\n", i + 1, c.name, loops,
+		       ns_per_call, 1000000000.0 / ns_per_call, (unsigned long)(after - before));
+
+		if (threads > 1 && is_submit_case(c) && !own_queues)
+		{
+			printf("\tskipping %d threads, they would have to share a queue\n", threads);
+		}
+		else if (threads > 1)
+		{
+			bench_start_scene(vulkan.bench, scene + " (" + std::to_string(threads) + " threads)");
+			run_threaded(vulkan, shared, objects, recorders, c, 1000000000.0 / ns_per_call);
+			bench_stop_scene(vulkan.bench);
+		}
 	}
-	uint64_t after = mygettime();
-	printf("Test case %d - %s, %d iterations: %lu\n", (int)variant, name, (int)loops, (unsigned long)(after - before));
 
+	for (stress_objects& o : objects) destroy_objects(vulkan, o);
+	destroy_shared(vulkan, shared);
 	test_done(vulkan);
 
 	return 0;
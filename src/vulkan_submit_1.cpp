@@ -0,0 +1,231 @@
+// Benchmark for queue submission granularity. Submits the same set of pre-recorded command buffers each frame,
+// sweeping the number of command buffers per batch and the number of batches per vkQueueSubmit call, which
+// together decide the number of submit calls. Optionally uses vkQueueSubmit2 and chains every batch to the
+// previous one with a timeline semaphore. Reports the CPU time spent in submit calls per command buffer.
+
+#include "vulkan_common.h"
+
+static int num_cmdbufs = 256;
+static int loops = 10;
+static int batch_size = 0; // zero means sweep
+static int batches = 0; // zero means sweep
+static bool submit2 = false;
+static bool timeline = false;
+
+static void show_usage()
+{
+	printf("-c/--cmdbufs N         Number of command buffers submitted per frame (default %d)\n", num_cmdbufs);
+	printf("-l/--loops N           Number of frames to run for each combination (default %d)\n", loops);
+	printf("-b/--batch-size N      Only test N command buffers per batch (default sweeps 1, 4, 16, ...)\n");
+	printf("-s/--batches N         Only test N batches per submit call (default sweeps 1, 4, 16, ...)\n");
+	printf("-2/--submit2           Use vkQueueSubmit2 instead of vkQueueSubmit (requires Vulkan 1.3)\n");
+	printf("-t/--timeline          Make each batch wait for the previous one with a timeline semaphore (requires Vulkan 1.2)\n");
+}
+
+static bool test_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
+{
+	if (match(argv[i], "-c", "--cmdbufs"))
+	{
+		num_cmdbufs = get_arg(argv, ++i, argc);
+		return num_cmdbufs > 0;
+	}
+	else if (match(argv[i], "-l", "--loops"))
+	{
+		loops = get_arg(argv, ++i, argc);
+		return loops > 0;
+	}
+	else if (match(argv[i], "-b", "--batch-size"))
+	{
+		batch_size = get_arg(argv, ++i, argc);
+		return batch_size > 0;
+	}
+	else if (match(argv[i], "-s", "--batches"))
+	{
+		batches = get_arg(argv, ++i, argc);
+		return batches > 0;
+	}
+	else if (match(argv[i], "-2", "--submit2"))
+	{
+		submit2 = true;
+		reqs.apiVersion = VK_API_VERSION_1_3;
+		reqs.minApiVersion = VK_API_VERSION_1_3;
+		reqs.reqfeat13.synchronization2 = VK_TRUE;
+		return true;
+	}
+	else if (match(argv[i], "-t", "--timeline"))
+	{
+		timeline = true;
+		if (reqs.apiVersion < VK_API_VERSION_1_2) reqs.apiVersion = VK_API_VERSION_1_2;
+		if (reqs.minApiVersion < VK_API_VERSION_1_2) reqs.minApiVersion = VK_API_VERSION_1_2;
+		reqs.reqfeat12.timelineSemaphore = VK_TRUE;
+		return true;
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	vulkan_req_t reqs;
+	reqs.usage = show_usage;
+	reqs.cmdopt = test_cmdopt;
+	vulkan_setup_t vulkan = test_init(argc, argv, "vulkan_submit_1", reqs);
+	VkResult result;
+
+	VkQueue queue;
+	vkGetDeviceQueue(vulkan.device, 0, 0, &queue);
+
+	VkCommandPool pool;
+	VkCommandPoolCreateInfo cmdcreateinfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr };
+	cmdcreateinfo.queueFamilyIndex = 0;
+	result = vkCreateCommandPool(vulkan.device, &cmdcreateinfo, nullptr, &pool);
+	check(result);
+	std::vector<VkCommandBuffer> cmds(num_cmdbufs);
+	VkCommandBufferAllocateInfo pAllocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr };
+	pAllocateInfo.commandBufferCount = num_cmdbufs;
+	pAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	pAllocateInfo.commandPool = pool;
+	result = vkAllocateCommandBuffers(vulkan.device, &pAllocateInfo, cmds.data());
+	check(result);
+
+	// Each command buffer holds a single barrier, so that submission overhead dominates
+	for (VkCommandBuffer cmd : cmds)
+	{
+		VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr };
+		result = vkBeginCommandBuffer(cmd, &beginInfo);
+		check(result);
+		VkMemoryBarrier memory_barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr };
+		memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+		result = vkEndCommandBuffer(cmd);
+		check(result);
+	}
+
+	VkFence fence;
+	VkFenceCreateInfo fence_create_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
+	result = vkCreateFence(vulkan.device, &fence_create_info, nullptr, &fence);
+	check(result);
+
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	uint64_t timeline_value = 0;
+	if (timeline)
+	{
+		VkSemaphoreTypeCreateInfo scsti = { VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO, nullptr };
+		scsti.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		scsti.initialValue = 0;
+		VkSemaphoreCreateInfo sci = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, &scsti };
+		result = vkCreateSemaphore(vulkan.device, &sci, nullptr, &semaphore);
+		check(result);
+	}
+
+	std::vector<int> batch_sizes;
+	for (int b = 1; b <= num_cmdbufs; b *= 4) if (batch_size == 0 || b == batch_size) batch_sizes.push_back(b);
+	if (batch_size > 0 && batch_sizes.empty()) batch_sizes.push_back(std::min(batch_size, num_cmdbufs));
+
+	// every combination of batch size and batches per submit, each one a scene of 'loops' samples
+	std::vector<std::pair<int, int>> combinations;
+	for (int b : batch_sizes)
+	{
+		const size_t first = combinations.size();
+		for (int s = 1; s * b <= num_cmdbufs; s *= 4) if (batches == 0 || s == batches) combinations.push_back({ b, s });
+		if (batches > 0 && combinations.size() == first && batches * b <= num_cmdbufs) combinations.push_back({ b, batches });
+	}
+	bench_reserve(vulkan.bench, combinations.size() * loops);
+
+	printf("%d command buffers per frame, %s%s\n", num_cmdbufs, submit2 ? "vkQueueSubmit2" : "vkQueueSubmit", timeline ? ", timeline semaphore between batches" : "");
+	for (const auto& combination : combinations)
+	{
+		const int b = combination.first;
+		const int s = combination.second;
+
+		const int submits = num_cmdbufs / (b * s);
+		const int total_batches = submits * s;
+		const int used = total_batches * b;
+
+		// Build all the submit structures up front so that only the submit calls themselves are timed
+		std::vector<uint64_t> wait_values(total_batches);
+		std::vector<uint64_t> signal_values(total_batches);
+		const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		std::vector<VkTimelineSemaphoreSubmitInfo> timeline_infos(total_batches, { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, nullptr });
+		std::vector<VkSubmitInfo> infos(total_batches, { VK_STRUCTURE_TYPE_SUBMIT_INFO, nullptr });
+		std::vector<VkCommandBufferSubmitInfo> cmd_infos(used, { VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, nullptr });
+		std::vector<VkSemaphoreSubmitInfo> wait_infos(total_batches, { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, nullptr });
+		std::vector<VkSemaphoreSubmitInfo> signal_infos(total_batches, { VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, nullptr });
+		std::vector<VkSubmitInfo2> infos2(total_batches, { VK_STRUCTURE_TYPE_SUBMIT_INFO_2, nullptr });
+		for (int i = 0; i < used; i++) cmd_infos[i].commandBuffer = cmds[i];
+		for (int i = 0; i < total_batches; i++)
+		{
+			infos[i].commandBufferCount = b;
+			infos[i].pCommandBuffers = &cmds[i * b];
+			infos2[i].commandBufferInfoCount = b;
+			infos2[i].pCommandBufferInfos = &cmd_infos[i * b];
+			if (!timeline) continue;
+			timeline_infos[i].waitSemaphoreValueCount = 1;
+			timeline_infos[i].pWaitSemaphoreValues = &wait_values[i];
+			timeline_infos[i].signalSemaphoreValueCount = 1;
+			timeline_infos[i].pSignalSemaphoreValues = &signal_values[i];
+			infos[i].pNext = &timeline_infos[i];
+			infos[i].waitSemaphoreCount = 1;
+			infos[i].pWaitSemaphores = &semaphore;
+			infos[i].pWaitDstStageMask = &wait_stage;
+			infos[i].signalSemaphoreCount = 1;
+			infos[i].pSignalSemaphores = &semaphore;
+			wait_infos[i].semaphore = semaphore;
+			wait_infos[i].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			signal_infos[i].semaphore = semaphore;
+			signal_infos[i].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			infos2[i].waitSemaphoreInfoCount = 1;
+			infos2[i].pWaitSemaphoreInfos = &wait_infos[i];
+			infos2[i].signalSemaphoreInfoCount = 1;
+			infos2[i].pSignalSemaphoreInfos = &signal_infos[i];
+		}
+
+		const std::string scene = _to_string(b) + " per batch, " + _to_string(s) + " batches per submit";
+		bench_start_scene(vulkan.bench, scene);
+		uint64_t submit_time = 0;
+		for (int frame = 0; frame < loops; frame++)
+		{
+			if (timeline)
+			{
+				for (int i = 0; i < total_batches; i++)
+				{
+					wait_values[i] = timeline_value + i;
+					signal_values[i] = timeline_value + i + 1;
+					wait_infos[i].value = wait_values[i];
+					signal_infos[i].value = signal_values[i];
+				}
+				timeline_value += total_batches;
+			}
+
+			bench_start_iteration(vulkan.bench);
+			const uint64_t start = gettime();
+			for (int j = 0; j < submits; j++)
+			{
+				const VkFence f = (j == submits - 1) ? fence : VK_NULL_HANDLE;
+				if (submit2) result = vkQueueSubmit2(queue, s, &infos2[j * s], f);
+				else result = vkQueueSubmit(queue, s, &infos[j * s], f);
+				check(result);
+			}
+			submit_time += gettime() - start;
+			bench_stop_iteration(vulkan.bench);
+
+			result = vkWaitForFences(vulkan.device, 1, &fence, VK_TRUE, UINT64_MAX);
+			check(result);
+			result = vkResetFences(vulkan.device, 1, &fence);
+			check(result);
+		}
+		bench_stop_scene(vulkan.bench);
+
+		printf("\t%4d per batch, %4d batches per submit, %4d submits: %.1f ns per command buffer, %.1f us per submit call\n", b, s, submits,
+		       (double)submit_time / loops / used, (double)submit_time / loops / submits / 1000.0);
+	}
+
+	// Cleanup...
+	if (semaphore != VK_NULL_HANDLE) vkDestroySemaphore(vulkan.device, semaphore, nullptr);
+	vkDestroyFence(vulkan.device, fence, nullptr);
+	vkFreeCommandBuffers(vulkan.device, pool, cmds.size(), cmds.data());
+	vkDestroyCommandPool(vulkan.device, pool, nullptr);
+
+	test_done(vulkan);
+	return 0;
+}
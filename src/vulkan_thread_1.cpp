@@ -15,6 +15,8 @@ static void thread_test_stress(int tid)
 	assert(used[tid] == 0);
 	used[tid] = 1;
 	assert(vulkan.device != VK_NULL_HANDLE);
+	bench_recorder& recorder = bench_thread_recorder(vulkan.bench, 1);
+	bench_start_iteration(recorder);
 
 	VkCommandPool cmdpool;
 	VkCommandPoolCreateInfo cmdcreateinfo = {};
@@ -42,6 +44,7 @@ static void thread_test_stress(int tid)
 
 	vkFreeCommandBuffers(vulkan.device, cmdpool, cmdbuffers.size(), cmdbuffers.data());
 	vkDestroyCommandPool(vulkan.device, cmdpool, nullptr);
+	bench_stop_iteration(recorder);
 
 	if (random() % 5 == 1) usleep(random() % 3 * 10000); // introduce some pseudo-random timings
 }
@@ -0,0 +1,260 @@
+// Performance test for multi-threaded recording. Worker threads each record a number of secondary command
+// buffers from their own command pool, then the main thread executes them all from one primary command
+// buffer and submits it to a single queue. Tracers that serialize command recording will not scale here.
+
+#include <condition_variable>
+#include <thread>
+#include <mutex>
+
+#include "vulkan_common.h"
+
+static int threads = 4;
+static int buffers = 16;
+static int commands = 1000;
+static int loops = 10;
+
+static vulkan_setup_t vulkan;
+
+// frame handshake between the main thread and the workers
+static std::mutex m;
+static std::condition_variable cv;
+static int frame_started = 0;
+static int workers_done = 0;
+static bool quit = false;
+
+struct worker
+{
+	VkCommandPool pool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> secondaries;
+	bench_recorder* recorder = nullptr;
+	uint64_t record_time = 0;
+};
+
+static void dummy_cmd(VkCommandBuffer cmd)
+{
+	VkMemoryBarrier memory_barrier = {};
+	memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, NULL, 0, NULL);
+}
+
+static void worker_thread(worker* w)
+{
+	set_thread_name("record thread");
+	VkCommandBufferInheritanceInfo inhinfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO, nullptr };
+	VkCommandBufferBeginInfo begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr };
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	begin_info.pInheritanceInfo = &inhinfo;
+	int frame = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lk(m);
+			cv.wait(lk, [&]{ return quit || frame_started > frame; });
+			if (quit) return;
+			frame = frame_started;
+		}
+
+		bench_start_iteration(*w->recorder);
+		const uint64_t start = gettime();
+		VkResult result = vkResetCommandPool(vulkan.device, w->pool, 0);
+		check(result);
+		for (VkCommandBuffer cmd : w->secondaries)
+		{
+			result = vkBeginCommandBuffer(cmd, &begin_info);
+			check(result);
+			for (int i = 0; i < commands; i++) dummy_cmd(cmd);
+			result = vkEndCommandBuffer(cmd);
+			check(result);
+		}
+		w->record_time += gettime() - start;
+		bench_stop_iteration(*w->recorder);
+
+		std::lock_guard<std::mutex> lk(m);
+		workers_done++;
+		cv.notify_all();
+	}
+}
+
+static void show_usage()
+{
+	printf("-T/--threads N         Number of recording threads (default %d)\n", threads);
+	printf("-b/--buffers N         Secondary command buffers recorded by each thread per frame (default %d)\n", buffers);
+	printf("-c/--commands N        Commands recorded into each secondary command buffer (default %d)\n", commands);
+	printf("-l/--loops N           Number of frames to run (default %d)\n", loops);
+}
+
+static bool test_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
+{
+	if (match(argv[i], "-T", "--threads"))
+	{
+		threads = get_arg(argv, ++i, argc);
+		return threads > 0;
+	}
+	else if (match(argv[i], "-b", "--buffers"))
+	{
+		buffers = get_arg(argv, ++i, argc);
+		return buffers > 0;
+	}
+	else if (match(argv[i], "-c", "--commands"))
+	{
+		commands = get_arg(argv, ++i, argc);
+		return commands >= 0;
+	}
+	else if (match(argv[i], "-l", "--loops"))
+	{
+		loops = get_arg(argv, ++i, argc);
+		return loops > 0;
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	vulkan_req_t reqs;
+	reqs.usage = show_usage;
+	reqs.cmdopt = test_cmdopt;
+	vulkan = test_init(argc, argv, "vulkan_thread_5", reqs);
+
+	VkQueue queue;
+	vkGetDeviceQueue(vulkan.device, 0, 0, &queue);
+
+	VkCommandPoolCreateInfo cmdcreateinfo = {};
+	cmdcreateinfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	cmdcreateinfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	cmdcreateinfo.queueFamilyIndex = 0;
+
+	VkCommandPool primary_pool;
+	VkResult result = vkCreateCommandPool(vulkan.device, &cmdcreateinfo, nullptr, &primary_pool);
+	check(result);
+	test_set_name(vulkan, VK_OBJECT_TYPE_COMMAND_POOL, (uint64_t)primary_pool, "Primary pool");
+	VkCommandBuffer primary;
+	VkCommandBufferAllocateInfo pAllocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr };
+	pAllocateInfo.commandPool = primary_pool;
+	pAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	pAllocateInfo.commandBufferCount = 1;
+	result = vkAllocateCommandBuffers(vulkan.device, &pAllocateInfo, &primary);
+	check(result);
+
+	// one pool per thread, so that recording needs no external synchronization
+	std::vector<worker> workers(threads);
+	std::vector<VkCommandBuffer> all_secondaries;
+	for (int t = 0; t < threads; t++)
+	{
+		worker& w = workers[t];
+		result = vkCreateCommandPool(vulkan.device, &cmdcreateinfo, nullptr, &w.pool);
+		check(result);
+		std::string name = "Pool for thread " + _to_string(t);
+		test_set_name(vulkan, VK_OBJECT_TYPE_COMMAND_POOL, (uint64_t)w.pool, name.c_str());
+		w.secondaries.resize(buffers);
+		pAllocateInfo.commandPool = w.pool;
+		pAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		pAllocateInfo.commandBufferCount = buffers;
+		result = vkAllocateCommandBuffers(vulkan.device, &pAllocateInfo, w.secondaries.data());
+		check(result);
+		all_secondaries.insert(all_secondaries.end(), w.secondaries.begin(), w.secondaries.end());
+	}
+
+	VkFence fence;
+	VkFenceCreateInfo fence_create_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr };
+	result = vkCreateFence(vulkan.device, &fence_create_info, nullptr, &fence);
+	check(result);
+
+	// three samples per frame on the main thread, and one per frame on each worker
+	bench_reserve(vulkan.bench, 3 * loops);
+
+	// recorders inherit the current scene, so register them here rather than racing the main loop
+	bench_start_scene(vulkan.bench, "record (per thread)");
+	for (worker& w : workers) w.recorder = &bench_thread_recorder(vulkan.bench, loops);
+	bench_stop_scene(vulkan.bench);
+	std::vector<std::thread> helpers;
+	for (worker& w : workers) helpers.emplace_back(worker_thread, &w);
+
+	uint64_t record_time = 0;
+	uint64_t execute_time = 0;
+	uint64_t submit_time = 0;
+	VkCommandBufferBeginInfo begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr };
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	for (int frame = 0; frame < loops; frame++)
+	{
+		// phase 1: all threads record their secondary command buffers
+		bench_start_scene(vulkan.bench, "record");
+		bench_start_iteration(vulkan.bench);
+		uint64_t start = gettime();
+		{
+			std::unique_lock<std::mutex> lk(m);
+			workers_done = 0;
+			frame_started++;
+			cv.notify_all();
+			cv.wait(lk, []{ return workers_done == threads; });
+		}
+		record_time += gettime() - start;
+		bench_stop_iteration(vulkan.bench);
+		bench_stop_scene(vulkan.bench);
+
+		// phase 2: execute them all from the primary command buffer
+		bench_start_scene(vulkan.bench, "execute");
+		bench_start_iteration(vulkan.bench);
+		start = gettime();
+		result = vkResetCommandPool(vulkan.device, primary_pool, 0);
+		check(result);
+		result = vkBeginCommandBuffer(primary, &begin_info);
+		check(result);
+		vkCmdExecuteCommands(primary, static_cast<uint32_t>(all_secondaries.size()), all_secondaries.data());
+		result = vkEndCommandBuffer(primary);
+		check(result);
+		execute_time += gettime() - start;
+		bench_stop_iteration(vulkan.bench);
+		bench_stop_scene(vulkan.bench);
+
+		// phase 3: submit, then wait before the command buffers are recorded again
+		bench_start_scene(vulkan.bench, "submit");
+		bench_start_iteration(vulkan.bench);
+		start = gettime();
+		VkSubmitInfo submit_info = { VK_STRUCTURE_TYPE_SUBMIT_INFO, nullptr };
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &primary;
+		result = vkQueueSubmit(queue, 1, &submit_info, fence);
+		check(result);
+		submit_time += gettime() - start;
+		bench_stop_iteration(vulkan.bench);
+		bench_stop_scene(vulkan.bench);
+
+		result = vkWaitForFences(vulkan.device, 1, &fence, VK_TRUE, UINT64_MAX);
+		check(result);
+		result = vkResetFences(vulkan.device, 1, &fence);
+		check(result);
+	}
+
+	{
+		std::lock_guard<std::mutex> lk(m);
+		quit = true;
+		cv.notify_all();
+	}
+	for (std::thread& t : helpers) t.join();
+
+	const double total_commands = (double)threads * buffers * commands * loops;
+	printf("%d threads x %d secondary command buffers x %d commands, %d frames\n", threads, buffers, commands, loops);
+	printf("Record: %.3f ms per frame, %.0f commands/sec in total\n", record_time / 1000000.0 / loops, total_commands * 1000000000.0 / record_time);
+	for (int t = 0; t < threads; t++)
+	{
+		const double thread_commands = (double)buffers * commands * loops;
+		printf("\tthread %d: %.3f ms per frame, %.0f commands/sec\n", t, workers[t].record_time / 1000000.0 / loops, thread_commands * 1000000000.0 / workers[t].record_time);
+	}
+	printf("Execute: %.3f ms per frame\n", execute_time / 1000000.0 / loops);
+	printf("Submit: %.3f ms per frame\n", submit_time / 1000000.0 / loops);
+
+	vkDestroyFence(vulkan.device, fence, nullptr);
+	for (worker& w : workers)
+	{
+		vkFreeCommandBuffers(vulkan.device, w.pool, w.secondaries.size(), w.secondaries.data());
+		vkDestroyCommandPool(vulkan.device, w.pool, nullptr);
+	}
+	vkFreeCommandBuffers(vulkan.device, primary_pool, 1, &primary);
+	vkDestroyCommandPool(vulkan.device, primary_pool, nullptr);
+	test_done(vulkan);
+	return 0;
+}
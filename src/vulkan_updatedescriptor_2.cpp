@@ -0,0 +1,365 @@
+// Throughput benchmark for the different ways of updating descriptors. Sweeps the number of descriptors
+// updated per frame by decades from one up to the given maximum, which is always the last step, for the
+// chosen update path.
+
+#include "vulkan_common.h"
+
+enum update_mode
+{
+	MODE_WRITE,
+	MODE_COPY,
+	MODE_TEMPLATE,
+	MODE_PUSH,
+	MODE_DESCRIPTOR_BUFFER,
+	MODE_COUNT
+};
+
+static const char* mode_names[MODE_COUNT] = { "write", "copy", "template", "push descriptor", "descriptor buffer" };
+
+static int mode = MODE_WRITE;
+static int max_descriptors = 100000;
+static int loops = 10;
+
+static const int set_size = 10; // descriptors per set, so that every step of the sweep fills whole sets
+static const VkDeviceSize range = 256; // each descriptor points to its own range of the buffer
+static const VkDeviceSize buffer_size = range * 256;
+
+static PFN_vkCmdPushDescriptorSetKHR pf_vkCmdPushDescriptorSetKHR = nullptr;
+static PFN_vkGetDescriptorEXT pf_vkGetDescriptorEXT = nullptr;
+
+static VkPhysicalDeviceDescriptorBufferFeaturesEXT pddbf = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT, nullptr };
+
+static void show_usage()
+{
+	printf("-m/--mode N            Descriptor update path to measure (default %d)\n", mode);
+	for (int i = 0; i < MODE_COUNT; i++) printf("\t%d - %s\n", i, mode_names[i]);
+	printf("-n/--descriptors N     Largest number of descriptors updated per frame, above 10 rounded up to a multiple of 10 (default %d)\n", max_descriptors);
+	printf("-l/--loops N           Number of frames to run for each step (default %d)\n", loops);
+}
+
+static bool test_cmdopt(int& i, int argc, char** argv, vulkan_req_t& reqs)
+{
+	if (match(argv[i], "-m", "--mode"))
+	{
+		mode = get_arg(argv, ++i, argc);
+		if (mode == MODE_PUSH)
+		{
+			reqs.device_extensions.push_back("VK_KHR_push_descriptor");
+		}
+		else if (mode == MODE_DESCRIPTOR_BUFFER)
+		{
+			pddbf.descriptorBuffer = VK_TRUE;
+			reqs.bufferDeviceAddress = true;
+			reqs.apiVersion = VK_API_VERSION_1_3;
+			reqs.minApiVersion = VK_API_VERSION_1_3;
+			reqs.device_extensions.push_back("VK_EXT_descriptor_buffer");
+			reqs.extension_features = (VkBaseInStructure*)&pddbf;
+		}
+		return mode >= 0 && mode < MODE_COUNT;
+	}
+	else if (match(argv[i], "-n", "--descriptors"))
+	{
+		max_descriptors = get_arg(argv, ++i, argc);
+		return max_descriptors > 0;
+	}
+	else if (match(argv[i], "-l", "--loops"))
+	{
+		loops = get_arg(argv, ++i, argc);
+		return loops > 0;
+	}
+	return false;
+}
+
+int main(int argc, char** argv)
+{
+	vulkan_req_t reqs;
+	reqs.usage = show_usage;
+	reqs.cmdopt = test_cmdopt;
+	reqs.apiVersion = VK_API_VERSION_1_1; // for descriptor update templates
+	reqs.minApiVersion = VK_API_VERSION_1_1;
+	vulkan_setup_t vulkan = test_init(argc, argv, "vulkan_updatedescriptor_2", reqs);
+	const int max_sets = (max_descriptors + set_size - 1) / set_size;
+	if (max_descriptors > set_size) max_descriptors = max_sets * set_size; // only whole sets above one set
+	VkResult result;
+
+	// One buffer that all the descriptors point into
+	VkBuffer buffer;
+	VkBufferCreateInfo bufferCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, nullptr };
+	bufferCreateInfo.size = buffer_size;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	if (mode == MODE_DESCRIPTOR_BUFFER) bufferCreateInfo.usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	result = vkCreateBuffer(vulkan.device, &bufferCreateInfo, nullptr, &buffer);
+	check(result);
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(vulkan.device, buffer, &req);
+	VkMemoryAllocateFlagsInfo memext = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO, nullptr };
+	memext.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+	VkMemoryAllocateInfo pAllocateMemInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, (mode == MODE_DESCRIPTOR_BUFFER) ? &memext : nullptr };
+	pAllocateMemInfo.memoryTypeIndex = get_device_memory_type(req.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	pAllocateMemInfo.allocationSize = req.size;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	result = vkAllocateMemory(vulkan.device, &pAllocateMemInfo, nullptr, &memory);
+	check(result);
+	vkBindBufferMemory(vulkan.device, buffer, memory, 0);
+
+	std::vector<VkDescriptorBufferInfo> descbufinfo(max_sets * set_size);
+	for (unsigned i = 0; i < descbufinfo.size(); i++)
+	{
+		descbufinfo[i].buffer = buffer;
+		descbufinfo[i].offset = (i % (buffer_size / range)) * range;
+		descbufinfo[i].range = range;
+	}
+
+	VkDescriptorSetLayoutBinding binding = {};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	binding.descriptorCount = set_size;
+	binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	VkDescriptorSetLayoutCreateInfo cdslayout = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr };
+	cdslayout.bindingCount = 1;
+	cdslayout.pBindings = &binding;
+	if (mode == MODE_PUSH) cdslayout.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+	else if (mode == MODE_DESCRIPTOR_BUFFER) cdslayout.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+	VkDescriptorSetLayout dslayout;
+	result = vkCreateDescriptorSetLayout(vulkan.device, &cdslayout, nullptr, &dslayout);
+	check(result);
+
+	// Descriptor sets, with a second set of sets to copy from for the copy path
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> sets;
+	std::vector<VkDescriptorSet> source_sets;
+	if (mode == MODE_WRITE || mode == MODE_COPY || mode == MODE_TEMPLATE)
+	{
+		VkDescriptorPoolSize dps;
+		dps.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		dps.descriptorCount = max_sets * set_size * 2;
+		VkDescriptorPoolCreateInfo cdspool = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, nullptr };
+		cdspool.maxSets = max_sets * 2;
+		cdspool.poolSizeCount = 1;
+		cdspool.pPoolSizes = &dps;
+		result = vkCreateDescriptorPool(vulkan.device, &cdspool, nullptr, &pool);
+		check(result);
+
+		std::vector<VkDescriptorSetLayout> layouts(max_sets, dslayout);
+		VkDescriptorSetAllocateInfo dsai = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, nullptr };
+		dsai.descriptorPool = pool;
+		dsai.descriptorSetCount = max_sets;
+		dsai.pSetLayouts = layouts.data();
+		sets.resize(max_sets);
+		result = vkAllocateDescriptorSets(vulkan.device, &dsai, sets.data());
+		check(result);
+		if (mode == MODE_COPY)
+		{
+			source_sets.resize(max_sets);
+			result = vkAllocateDescriptorSets(vulkan.device, &dsai, source_sets.data());
+			check(result);
+			std::vector<VkWriteDescriptorSet> writes(max_sets, { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr });
+			for (int s = 0; s < max_sets; s++)
+			{
+				writes[s].dstSet = source_sets[s];
+				writes[s].descriptorCount = set_size;
+				writes[s].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+				writes[s].pBufferInfo = &descbufinfo.at(s * set_size);
+			}
+			vkUpdateDescriptorSets(vulkan.device, writes.size(), writes.data(), 0, nullptr);
+		}
+	}
+
+	// Command buffer for the push descriptor path
+	VkCommandPool cmdpool = VK_NULL_HANDLE;
+	VkCommandBuffer cmd = VK_NULL_HANDLE;
+	VkPipelineLayout pipelinelayout = VK_NULL_HANDLE;
+	if (mode == MODE_PUSH)
+	{
+		VkCommandPoolCreateInfo cmdcreateinfo = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr };
+		cmdcreateinfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		cmdcreateinfo.queueFamilyIndex = 0;
+		result = vkCreateCommandPool(vulkan.device, &cmdcreateinfo, nullptr, &cmdpool);
+		check(result);
+		VkCommandBufferAllocateInfo pAllocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr };
+		pAllocateInfo.commandBufferCount = 1;
+		pAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		pAllocateInfo.commandPool = cmdpool;
+		result = vkAllocateCommandBuffers(vulkan.device, &pAllocateInfo, &cmd);
+		check(result);
+
+		VkPipelineLayoutCreateInfo plci = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, nullptr };
+		plci.setLayoutCount = 1;
+		plci.pSetLayouts = &dslayout;
+		result = vkCreatePipelineLayout(vulkan.device, &plci, nullptr, &pipelinelayout);
+		check(result);
+
+		pf_vkCmdPushDescriptorSetKHR = (PFN_vkCmdPushDescriptorSetKHR)vkGetDeviceProcAddr(vulkan.device, "vkCmdPushDescriptorSetKHR");
+		assert(pf_vkCmdPushDescriptorSetKHR);
+	}
+
+	// Descriptor buffer for the descriptor buffer path
+	VkBuffer descriptor_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory descriptor_memory = VK_NULL_HANDLE;
+	char* descriptor_ptr = nullptr;
+	VkDeviceSize layout_size = 0;
+	VkDeviceSize binding_offset = 0;
+	VkDeviceSize descriptor_size = 0;
+	VkDeviceAddress buffer_address = 0;
+	if (mode == MODE_DESCRIPTOR_BUFFER)
+	{
+		MAKEDEVICEPROCADDR(vulkan, vkGetDescriptorSetLayoutSizeEXT);
+		MAKEDEVICEPROCADDR(vulkan, vkGetDescriptorSetLayoutBindingOffsetEXT);
+		pf_vkGetDescriptorEXT = (PFN_vkGetDescriptorEXT)vkGetDeviceProcAddr(vulkan.device, "vkGetDescriptorEXT");
+		assert(pf_vkGetDescriptorEXT);
+		VkPhysicalDeviceDescriptorBufferPropertiesEXT pddbp = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT, nullptr };
+		VkPhysicalDeviceProperties2 pdp = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, &pddbp };
+		vkGetPhysicalDeviceProperties2(vulkan.physical, &pdp);
+		descriptor_size = pddbp.uniformBufferDescriptorSize;
+		pf_vkGetDescriptorSetLayoutSizeEXT(vulkan.device, dslayout, &layout_size);
+		pf_vkGetDescriptorSetLayoutBindingOffsetEXT(vulkan.device, dslayout, 0, &binding_offset);
+		layout_size = (layout_size + pddbp.descriptorBufferOffsetAlignment - 1) & ~(pddbp.descriptorBufferOffsetAlignment - 1);
+
+		bufferCreateInfo.size = layout_size * max_sets;
+		bufferCreateInfo.usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT;
+		result = vkCreateBuffer(vulkan.device, &bufferCreateInfo, nullptr, &descriptor_buffer);
+		check(result);
+		vkGetBufferMemoryRequirements(vulkan.device, descriptor_buffer, &req);
+		pAllocateMemInfo.memoryTypeIndex = get_device_memory_type(req.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		pAllocateMemInfo.allocationSize = req.size;
+		result = vkAllocateMemory(vulkan.device, &pAllocateMemInfo, nullptr, &descriptor_memory);
+		check(result);
+		vkBindBufferMemory(vulkan.device, descriptor_buffer, descriptor_memory, 0);
+		result = vkMapMemory(vulkan.device, descriptor_memory, 0, VK_WHOLE_SIZE, 0, (void**)&descriptor_ptr);
+		check(result);
+
+		VkBufferDeviceAddressInfo address_info = { VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, nullptr };
+		address_info.buffer = buffer;
+		buffer_address = vkGetBufferDeviceAddress(vulkan.device, &address_info);
+	}
+
+	std::vector<int> steps;
+	for (int count = 1; count < max_descriptors; count *= 10) steps.push_back(count);
+	steps.push_back(max_descriptors);
+	bench_reserve(vulkan.bench, steps.size() * loops);
+
+	for (int count : steps)
+	{
+		const int per_set = std::min(count, set_size);
+		const int num_sets = count / per_set;
+
+		// Templates are made for a fixed number of descriptors, so create one for each step
+		VkDescriptorUpdateTemplate update_template = VK_NULL_HANDLE;
+		if (mode == MODE_TEMPLATE)
+		{
+			VkDescriptorUpdateTemplateEntry entry = {};
+			entry.dstBinding = 0;
+			entry.dstArrayElement = 0;
+			entry.descriptorCount = per_set;
+			entry.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			entry.offset = 0;
+			entry.stride = sizeof(VkDescriptorBufferInfo);
+			VkDescriptorUpdateTemplateCreateInfo dutci = { VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO, nullptr };
+			dutci.descriptorUpdateEntryCount = 1;
+			dutci.pDescriptorUpdateEntries = &entry;
+			dutci.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+			dutci.descriptorSetLayout = dslayout;
+			result = vkCreateDescriptorUpdateTemplate(vulkan.device, &dutci, nullptr, &update_template);
+			check(result);
+		}
+
+		std::vector<VkWriteDescriptorSet> writes(num_sets, { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr });
+		std::vector<VkCopyDescriptorSet> copies(num_sets, { VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET, nullptr });
+		for (int s = 0; s < num_sets; s++)
+		{
+			writes[s].dstSet = sets.empty() ? VK_NULL_HANDLE : sets[s];
+			writes[s].descriptorCount = per_set;
+			writes[s].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			writes[s].pBufferInfo = &descbufinfo.at(s * set_size);
+			if (mode == MODE_COPY)
+			{
+				copies[s].srcSet = source_sets[s];
+				copies[s].dstSet = sets[s];
+				copies[s].descriptorCount = per_set;
+			}
+		}
+
+		const std::string scene = std::string(mode_names[mode]) + " : " + _to_string(count) + " descriptors";
+		bench_start_scene(vulkan.bench, scene);
+		uint64_t elapsed = 0;
+		for (int frame = 0; frame < loops; frame++)
+		{
+			bench_start_iteration(vulkan.bench);
+			const uint64_t start = gettime();
+			switch (mode)
+			{
+			case MODE_WRITE:
+				for (int s = 0; s < num_sets; s++) vkUpdateDescriptorSets(vulkan.device, 1, &writes[s], 0, nullptr);
+				break;
+			case MODE_COPY:
+				for (int s = 0; s < num_sets; s++) vkUpdateDescriptorSets(vulkan.device, 0, nullptr, 1, &copies[s]);
+				break;
+			case MODE_TEMPLATE:
+				for (int s = 0; s < num_sets; s++) vkUpdateDescriptorSetWithTemplate(vulkan.device, sets[s], update_template, &descbufinfo.at(s * set_size));
+				break;
+			case MODE_PUSH:
+			{
+				VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr };
+				beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+				result = vkBeginCommandBuffer(cmd, &beginInfo);
+				check(result);
+				for (int s = 0; s < num_sets; s++) pf_vkCmdPushDescriptorSetKHR(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipelinelayout, 0, 1, &writes[s]);
+				result = vkEndCommandBuffer(cmd);
+				check(result);
+				break;
+			}
+			case MODE_DESCRIPTOR_BUFFER:
+				for (int s = 0; s < num_sets; s++)
+				{
+					for (int d = 0; d < per_set; d++)
+					{
+						const VkDescriptorBufferInfo& info = descbufinfo[s * set_size + d];
+						VkDescriptorAddressInfoEXT daie = { VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT, nullptr };
+						daie.address = buffer_address + info.offset;
+						daie.range = info.range;
+						VkDescriptorGetInfoEXT dgi = { VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT, nullptr };
+						dgi.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+						dgi.data.pUniformBuffer = &daie;
+						pf_vkGetDescriptorEXT(vulkan.device, &dgi, descriptor_size, descriptor_ptr + s * layout_size + binding_offset + d * descriptor_size);
+					}
+				}
+				if (vulkan.has_explicit_host_updates) testFlushMemory(vulkan, descriptor_memory, 0, num_sets * layout_size, vulkan.has_explicit_host_updates);
+				break;
+			default:
+				assert(false);
+				break;
+			}
+			elapsed += gettime() - start;
+			bench_stop_iteration(vulkan.bench);
+		}
+		bench_stop_scene(vulkan.bench);
+
+		const double ns_per_descriptor = (double)elapsed / loops / count;
+		printf("%s: %d descriptors per frame in %d calls, %.1f ns per descriptor, %.0f descriptors/sec\n", mode_names[mode], count,
+		       (mode == MODE_DESCRIPTOR_BUFFER) ? count : num_sets, ns_per_descriptor, 1000000000.0 / ns_per_descriptor);
+
+		if (update_template != VK_NULL_HANDLE) vkDestroyDescriptorUpdateTemplate(vulkan.device, update_template, nullptr);
+	}
+
+	// Cleanup...
+	if (descriptor_buffer != VK_NULL_HANDLE)
+	{
+		vkUnmapMemory(vulkan.device, descriptor_memory);
+		vkDestroyBuffer(vulkan.device, descriptor_buffer, nullptr);
+		testFreeMemory(vulkan, descriptor_memory);
+	}
+	if (cmd != VK_NULL_HANDLE)
+	{
+		vkFreeCommandBuffers(vulkan.device, cmdpool, 1, &cmd);
+		vkDestroyCommandPool(vulkan.device, cmdpool, nullptr);
+		vkDestroyPipelineLayout(vulkan.device, pipelinelayout, nullptr);
+	}
+	if (pool != VK_NULL_HANDLE) vkDestroyDescriptorPool(vulkan.device, pool, nullptr);
+	vkDestroyDescriptorSetLayout(vulkan.device, dslayout, nullptr);
+	vkDestroyBuffer(vulkan.device, buffer, nullptr);
+	testFreeMemory(vulkan, memory);
+
+	test_done(vulkan);
+	return 0;
+}
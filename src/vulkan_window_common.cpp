@@ -96,6 +96,21 @@ static void window_fullscreen(testwindow& w, bool value)
 	(void)value;
 }
 
+testwindow test_window_create_headless(const vulkan_setup_t& vulkan)
+{
+	MAKEINSTANCEPROCADDR(vulkan, vkCreateHeadlessSurfaceEXT);
+
+	testwindow ret = {};
+	VkHeadlessSurfaceCreateInfoEXT pInfo = { VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT, nullptr };
+	pInfo.flags = 0;
+	VkResult result = pf_vkCreateHeadlessSurfaceEXT(vulkan.instance, &pInfo, nullptr, &ret.surface);
+	if (result != VK_SUCCESS)
+	{
+		ABORT("Failed to create headless surface");
+	}
+	return ret;
+}
+
 testwindow test_window_create(const vulkan_setup_t& vulkan, int32_t x, int32_t y, int32_t width, int32_t height, bool fullscreen)
 {
 #if VK_USE_PLATFORM_XCB_KHR
@@ -186,17 +201,7 @@ testwindow test_window_create(const vulkan_setup_t& vulkan, int32_t x, int32_t y
 	(void)fullscreen;
 	return xcb;
 #elif USE_HEADLESS
-
-	MAKEINSTANCEPROCADDR(vulkan, vkCreateHeadlessSurfaceEXT);
-
-	testwindow ret = {};
-	VkHeadlessSurfaceCreateInfoEXT pInfo = { VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT, nullptr };
-	pInfo.flags = 0;
-	VkResult result = pf_vkCreateHeadlessSurfaceEXT(vulkan.instance, &pInfo, nullptr, &ret.surface);
-	if (result != VK_SUCCESS)
-	{
-		ABORT("Failed to create headless surface");
-	}
+	return test_window_create_headless(vulkan);
 #else
 	testwindow ret = {};
 	return ret;
@@ -30,4 +30,6 @@ struct testwindow
 #endif
 
 testwindow test_window_create(const vulkan_setup_t& vulkan, int32_t x, int32_t y, int32_t width, int32_t height, bool fullscreen = false);
+/// Create a surface with VK_EXT_headless_surface, which must be enabled on the instance. Needs no display.
+testwindow test_window_create_headless(const vulkan_setup_t& vulkan);
 void test_window_destroy(const vulkan_setup_t& vulkan, testwindow &w);